@@ -0,0 +1,40 @@
+#include "allocation_counter.h"
+
+#ifdef SEARCH_SERVER_COUNT_ALLOCATIONS
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+thread_local size_t allocation_count = 0;
+
+} // namespace
+
+size_t GetThreadAllocationCount() {
+    return allocation_count;
+}
+
+void* operator new(size_t size) {
+    ++allocation_count;
+    if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    std::free(memory);
+}
+
+#else
+
+size_t GetThreadAllocationCount() {
+    return 0;
+}
+
+#endif
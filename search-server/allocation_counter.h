@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+
+// Counting replaces the global operator new of the whole program, so it is compiled only into
+// test builds with SEARCH_SERVER_COUNT_ALLOCATIONS defined. Without it the count is always 0.
+#ifdef SEARCH_SERVER_COUNT_ALLOCATIONS
+const bool IS_ALLOCATION_COUNTED = true;
+#else
+const bool IS_ALLOCATION_COUNTED = false;
+#endif
+
+// allocations made by the calling thread so far, counted by the replaced global operator new
+size_t GetThreadAllocationCount();
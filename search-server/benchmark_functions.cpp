@@ -0,0 +1,402 @@
+#include "benchmark_functions.h"
+
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <stdexcept>
+
+#include "instrumentation.h"
+
+#include "log_duration.h"
+#include "process_queries.h"
+
+using namespace std::string_literals;
+
+std::string GenerateWord(std::mt19937& generator, int max_length) {
+    const int length = std::uniform_int_distribution(1, max_length)(generator);
+    std::string word;
+    word.reserve(length);
+    for (int i = 0; i < length; ++i) {
+        word.push_back(std::uniform_int_distribution('a', 'z')(generator));
+    }
+    return word;
+}
+
+std::vector<std::string> GenerateDictionary(std::mt19937& generator, int word_count, int max_length) {
+    std::vector<std::string> words;
+    words.reserve(word_count);
+    for (int i = 0; i < word_count; ++i) {
+        words.push_back(GenerateWord(generator, max_length));
+    }
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+    return words;
+}
+
+std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string>& dictionary, int word_count, double minus_prob) {
+    std::string query;
+    for (int i = 0; i < word_count; ++i) {
+        if (!query.empty()) {
+            query.push_back(' ');
+        }
+        if (std::uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
+            query.push_back('-');
+        }
+        query += dictionary[std::uniform_int_distribution<int>(0, dictionary.size() - 1)(generator)];
+    }
+    return query;
+}
+
+std::vector<std::string> GenerateQueries(std::mt19937& generator, const std::vector<std::string>& dictionary, int query_count, int max_word_count) {
+    std::vector<std::string> queries;
+    queries.reserve(query_count);
+    for (int i = 0; i < query_count; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, max_word_count));
+    }
+    return queries;
+}
+
+namespace {
+
+const int POSTING_SCAN_REPEAT_COUNT = 2;
+const int PRUNED_SEARCH_QUERY_COUNT = 1000;
+const int COMPRESSED_SEARCH_QUERY_COUNT = 300;
+const int TOKENIZER_REPEAT_COUNT = 20;
+const int QUERY_ROUND_COUNT = 20;
+
+template <typename Index, typename AddPosting>
+Index BuildIndex(TermDictionary& dictionary, const std::vector<std::string>& documents, AddPosting add_posting) {
+    Index index;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const std::vector<std::string_view> words = SplitIntoWords(documents[i]);
+        std::map<TermId, int> term_counts;
+        for (const std::string_view word : words) {
+            ++term_counts[dictionary.Intern(word)];
+        }
+        index.resize(dictionary.size());
+        for (const auto [term_id, term_count] : term_counts) {
+            add_posting(index[term_id], static_cast<int>(i), term_count, static_cast<int>(words.size()));
+        }
+    }
+    return index;
+}
+
+template <typename Index, typename ScanPostings>
+void ScanIndex(std::string_view mark, const TermDictionary& dictionary, const Index& index,
+               const std::vector<std::string>& queries, ScanPostings scan_postings) {
+    LOG_DURATION(mark);
+    double total_term_freq = 0;
+    for (int repeat = 0; repeat < POSTING_SCAN_REPEAT_COUNT; ++repeat) {
+        for (const std::string& query : queries) {
+            for (const std::string_view word : SplitIntoWords(query)) {
+                const TermId term_id = dictionary.Find(word);
+                if (term_id != NO_TERM) {
+                    total_term_freq += scan_postings(index[term_id]);
+                }
+            }
+        }
+    }
+    std::cerr << total_term_freq << std::endl;
+}
+
+using QueryVariant = std::pair<std::string, std::function<std::vector<Document>(size_t)>>;
+
+// the variants take turns and the best round of each is printed, so a slow spell of the machine
+// doesn't fall on one of them. A variant is a mark and find_top(query_index)
+void RunQueryRounds(size_t query_count, const std::vector<QueryVariant>& variants) {
+    using Clock = std::chrono::steady_clock;
+    std::vector<Clock::duration> best_durations(variants.size(), Clock::duration::max());
+    std::vector<double> total_relevances(variants.size());
+    for (int round = 0; round < QUERY_ROUND_COUNT; ++round) {
+        for (size_t variant = 0; variant < variants.size(); ++variant) {
+            total_relevances[variant] = 0;
+            const auto start_time = Clock::now();
+            for (size_t i = 0; i < query_count; ++i) {
+                for (const Document& document : variants[variant].second(i)) {
+                    total_relevances[variant] += document.relevance;
+                }
+            }
+            best_durations[variant] = std::min(best_durations[variant], Clock::now() - start_time);
+        }
+    }
+    for (size_t variant = 0; variant < variants.size(); ++variant) {
+        std::cerr << variants[variant].first << ": "s << FormatDuration(best_durations[variant])
+                  << ", relevance "s << total_relevances[variant] << std::endl;
+    }
+}
+
+template <typename FindTop>
+void RunQueries(std::string_view mark, const std::vector<std::string>& queries, FindTop find_top) {
+    LOG_DURATION(mark);
+    double total_relevance = 0;
+    for (const std::string& query : queries) {
+        for (const Document& document : find_top(query)) {
+            total_relevance += document.relevance;
+        }
+    }
+    std::cerr << total_relevance << std::endl;
+}
+
+} // namespace
+
+void BenchmarkPostingLists(const std::vector<std::string>& documents, const std::vector<std::string>& queries) {
+    using MapIndex = std::vector<std::map<int, double>>;
+    using FlatIndex = std::vector<PostingList>;
+
+    TermDictionary map_dictionary;
+    MapIndex map_index;
+    {
+        LOG_DURATION("map postings build"s);
+        map_index = BuildIndex<MapIndex>(map_dictionary, documents, [](auto& postings, int document_id, int term_count, int document_length) {
+            postings.emplace(document_id, term_count * (1.0 / document_length));
+        });
+    }
+
+    TermDictionary flat_dictionary;
+    FlatIndex flat_index;
+    {
+        LOG_DURATION("flat postings build"s);
+        flat_index = BuildIndex<FlatIndex>(flat_dictionary, documents, [](auto& postings, int document_id, int term_count, int document_length) {
+            postings.Add(document_id, term_count, document_length);
+        });
+    }
+
+    ScanIndex("map postings scan"s, map_dictionary, map_index, queries, [](const std::map<int, double>& postings) {
+        double sum = 0;
+        for (const auto [document_id, term_freq] : postings) {
+            sum += term_freq;
+        }
+        return sum;
+    });
+
+    ScanIndex("flat postings scan"s, flat_dictionary, flat_index, queries, [](const PostingList& postings) {
+        double sum = 0;
+        postings.ForEach([&sum](int, const double term_freq) {
+            sum += term_freq;
+        });
+        return sum;
+    });
+}
+
+void BenchmarkPrunedSearch(const SearchServer& search_server, const std::vector<std::string>& dictionary) {
+    std::mt19937 generator(42);
+    for (const int word_count : { 2, 5, 70 }) {
+        const std::vector<std::string> queries = GenerateQueries(generator, dictionary, PRUNED_SEARCH_QUERY_COUNT, word_count);
+        const std::string words_mark = " ("s + std::to_string(word_count) + " words)"s;
+
+        RunQueries("exhaustive"s + words_mark, queries, [&search_server](const std::string& query) {
+            return search_server.FindTopDocuments(query);
+        });
+        RunQueries("pruned"s + words_mark, queries, [&search_server](const std::string& query) {
+            return search_server.FindTopDocumentsPruned(query);
+        });
+    }
+}
+
+void BenchmarkCompressedPostings(const std::vector<std::string>& documents, const std::vector<std::string>& dictionary) {
+    std::mt19937 generator(42);
+    const std::vector<std::string> short_queries = GenerateQueries(generator, dictionary, COMPRESSED_SEARCH_QUERY_COUNT, 3);
+    const std::vector<std::string> long_queries = GenerateQueries(generator, dictionary, COMPRESSED_SEARCH_QUERY_COUNT, 70);
+
+    for (const PostingFormat format : { PostingFormat::RAW, PostingFormat::COMPRESSED }) {
+        const std::string format_mark = format == PostingFormat::RAW ? "raw"s : "compressed"s;
+        SearchServer search_server(dictionary[0], format);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        }
+        // sealed segments only, as a loaded index is
+        search_server.WaitForMerges();
+
+        std::cerr << format_mark << " postings: "s << search_server.GetPostingsMemoryUsage() * 1.0 / search_server.GetPostingCount()
+                  << " bytes per posting"s << std::endl;
+        RunQueries(format_mark + " (3 words)"s, short_queries, [&search_server](const std::string& query) {
+            return search_server.FindTopDocuments(query);
+        });
+        RunQueries(format_mark + " (70 words)"s, long_queries, [&search_server](const std::string& query) {
+            return search_server.FindTopDocuments(query);
+        });
+        RunQueries(format_mark + " pruned (3 words)"s, short_queries, [&search_server](const std::string& query) {
+            return search_server.FindTopDocumentsPruned(query);
+        });
+    }
+}
+
+void BenchmarkAddDocuments(const std::vector<std::string>& documents, const std::vector<std::string>& dictionary) {
+    std::vector<NewDocument> batch;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        batch.push_back({static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, {1, 2, 3}});
+    }
+    {
+        LOG_DURATION("AddDocument one by one"s);
+        SearchServer search_server(dictionary[0]);
+        for (const NewDocument& document : batch) {
+            search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+        }
+    }
+    {
+        LOG_DURATION("AddDocuments seq"s);
+        SearchServer search_server(dictionary[0]);
+        search_server.AddDocuments(std::execution::seq, batch);
+    }
+    {
+        LOG_DURATION("AddDocuments par"s);
+        SearchServer search_server(dictionary[0]);
+        search_server.AddDocuments(std::execution::par, batch);
+    }
+}
+
+// runs split(text) over every document TOKENIZER_REPEAT_COUNT times and prints the throughput
+template <typename SplitFunc>
+void RunTokenizer(std::string_view mark, const std::vector<std::string>& documents, SplitFunc split) {
+    size_t byte_count = 0;
+    size_t word_count = 0;
+    const auto start_time = std::chrono::steady_clock::now();
+    for (int repeat = 0; repeat < TOKENIZER_REPEAT_COUNT; ++repeat) {
+        for (const std::string& document : documents) {
+            word_count += split(document);
+            byte_count += document.size();
+        }
+    }
+    const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start_time;
+    std::cerr << mark << ": "s << byte_count / duration.count() / (1 << 20) << " MB/s, "s
+              << word_count / TOKENIZER_REPEAT_COUNT << " words"s << std::endl;
+}
+
+void BenchmarkTokenizer(const std::vector<std::string>& documents) {
+    RunTokenizer("split and check separately"s, documents, [](const std::string_view text) {
+        const bool has_special_char = std::any_of(text.begin(), text.end(), [](const char c) {
+            return c >= 0 && c < ' ';
+        });
+        return has_special_char ? 0 : SplitIntoWords(text).size();
+    });
+    std::vector<std::string_view> words;
+    RunTokenizer("tokenizer with buffer"s, documents, [&words](const std::string_view text) {
+        return SplitIntoWords(text, words) ? words.size() : 0;
+    });
+}
+
+void BenchmarkPreparedQueries(const SearchServer& search_server, const std::vector<std::string>& queries) {
+    QueryContext context;
+    std::vector<PreparedQuery> prepared_queries;
+    for (const std::string& query : queries) {
+        prepared_queries.push_back(search_server.Prepare(query));
+    }
+    RunQueryRounds(queries.size(), {
+        {"raw queries"s, [&](const size_t i) {
+            return search_server.FindTopDocuments(queries[i]);
+        }},
+        {"raw queries with context"s, [&](const size_t i) {
+            return search_server.FindTopDocuments(context, queries[i]);
+        }},
+        {"prepared queries with context"s, [&](const size_t i) {
+            return search_server.FindTopDocuments(context, prepared_queries[i]);
+        }},
+    });
+
+    // an outdated prepared query would be resolved again on every search
+    for (const PreparedQuery& query : prepared_queries) {
+        if (query.GetIndexVersion() != search_server.GetIndexVersion()) {
+            throw std::logic_error("Prepared query was resolved again"s);
+        }
+    }
+}
+
+void BenchmarkStatusFilter(const std::vector<std::string>& documents, const std::vector<std::string>& queries) {
+    // a quarter of the documents of every status, so the filter keeps some and drops the rest
+    SearchServer search_server(""s);
+    std::vector<NewDocument> batch;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        batch.push_back({static_cast<int>(i), documents[i], static_cast<DocumentStatus>(i % DOCUMENT_STATUS_COUNT), {1, 2, 3}});
+    }
+    search_server.AddDocuments(batch);
+    const auto find_with_predicate = [&search_server](const std::string& query) {
+        return search_server.FindTopDocuments(query, [](int, DocumentStatus status, int) {
+            return status == DocumentStatus::BANNED;
+        });
+    };
+    const auto find_with_bitmap = [&search_server](const std::string& query) {
+        return search_server.FindTopDocuments(query, DocumentStatus::BANNED);
+    };
+    size_t found_count = 0;
+    for (const std::string& query : queries) {
+        const std::vector<Document> expected = find_with_predicate(query);
+        const std::vector<Document> found = find_with_bitmap(query);
+        const bool is_same = std::equal(expected.begin(), expected.end(), found.begin(), found.end(),
+                                        [](const Document& lhs, const Document& rhs) {
+            return lhs.id == rhs.id && lhs.relevance == rhs.relevance;
+        });
+        if (!is_same) {
+            throw std::logic_error("Status bitmap and predicate found different documents for "s + query);
+        }
+        found_count += found.size();
+    }
+    if (found_count == 0) {
+        throw std::logic_error("No documents of the status were found"s);
+    }
+    std::cerr << "documents found by status: "s << found_count << std::endl;
+
+    RunQueryRounds(queries.size(), {
+        {"status through predicate"s, [&](const size_t i) {
+            return find_with_predicate(queries[i]);
+        }},
+        {"status through bitmap"s, [&](const size_t i) {
+            return find_with_bitmap(queries[i]);
+        }},
+    });
+}
+
+void BenchmarkQueryExecutor(const SearchServer& search_server, const std::vector<std::string>& queries) {
+    {
+        LOG_DURATION("std::transform(par) over queries"s);
+        std::vector<std::vector<Document>> results(queries.size());
+        std::transform(std::execution::par, queries.begin(), queries.end(), results.begin(), [&search_server](const std::string& query) {
+            return search_server.FindTopDocuments(query);
+        });
+    }
+    QueryLatencies latencies;
+    {
+        LOG_DURATION("ProcessQueries on the executor"s);
+        ProcessQueries(GetDefaultQueryExecutor(), search_server, queries, &latencies);
+    }
+    std::cerr << "query latency: p50 "s << FormatDuration(latencies.p50) << ", p90 "s << FormatDuration(latencies.p90)
+              << ", p99 "s << FormatDuration(latencies.p99) << ", max "s << FormatDuration(latencies.max) << std::endl;
+}
+
+void BenchmarkProbes(const SearchServer& search_server, const std::vector<std::string>& queries) {
+#ifdef SEARCH_SERVER_PROBES
+    ResetProbeStats();
+    for (const std::string& query : queries) {
+        search_server.FindTopDocuments(query);
+        search_server.FindTopDocuments(std::execution::par, query);
+    }
+    DumpProbeStats(std::cerr);
+    std::cerr << std::endl;
+#else
+    static_cast<void>(search_server);
+    static_cast<void>(queries);
+    std::cerr << "search probes are off, build with -DSEARCH_SERVER_PROBES"s << std::endl;
+#endif
+}
+
+void BenchmarkSnapshot(const SearchServer& search_server, const std::vector<std::string>& queries) {
+    const std::string path = (std::filesystem::temp_directory_path() / "search_server_benchmark.snapshot"s).string();
+    {
+        LOG_DURATION("save snapshot"s);
+        search_server.SaveSnapshot(path);
+    }
+    std::cerr << "snapshot size: "s << std::filesystem::file_size(path) << " bytes"s << std::endl;
+
+    std::optional<SearchServer> loaded;
+    {
+        LOG_DURATION("load snapshot"s);
+        loaded.emplace(SearchServer::LoadSnapshot(path));
+    }
+    RunQueries("queries on original server"s, queries, [&search_server](const std::string& query) {
+        return search_server.FindTopDocuments(query);
+    });
+    RunQueries("queries on loaded snapshot"s, queries, [&loaded](const std::string& query) {
+        return loaded->FindTopDocuments(query);
+    });
+    loaded.reset();
+    std::filesystem::remove(path);
+}
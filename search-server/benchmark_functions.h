@@ -0,0 +1,38 @@
+#pragma once
+
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "search_server.h"
+
+std::string GenerateWord(std::mt19937& generator, int max_length);
+
+std::vector<std::string> GenerateDictionary(std::mt19937& generator, int word_count, int max_length);
+
+std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string>& dictionary, int word_count, double minus_prob = 0);
+
+std::vector<std::string> GenerateQueries(std::mt19937& generator, const std::vector<std::string>& dictionary, int query_count, int max_word_count);
+
+void BenchmarkPostingLists(const std::vector<std::string>& documents, const std::vector<std::string>& queries);
+
+void BenchmarkPrunedSearch(const SearchServer& search_server, const std::vector<std::string>& dictionary);
+
+void BenchmarkCompressedPostings(const std::vector<std::string>& documents, const std::vector<std::string>& dictionary);
+
+void BenchmarkAddDocuments(const std::vector<std::string>& documents, const std::vector<std::string>& dictionary);
+
+void BenchmarkTokenizer(const std::vector<std::string>& documents);
+
+void BenchmarkPreparedQueries(const SearchServer& search_server, const std::vector<std::string>& queries);
+
+// documents of all statuses, searched for one of them through a predicate and through the status bitmap
+void BenchmarkStatusFilter(const std::vector<std::string>& documents, const std::vector<std::string>& queries);
+
+void BenchmarkQueryExecutor(const SearchServer& search_server, const std::vector<std::string>& queries);
+
+// stages of the queries by the search probes
+void BenchmarkProbes(const SearchServer& search_server, const std::vector<std::string>& queries);
+
+void BenchmarkSnapshot(const SearchServer& search_server, const std::vector<std::string>& queries);
@@ -0,0 +1,27 @@
+#include "concurrent_search_server.h"
+
+void ConcurrentSearchServer::Update(const std::function<void(SearchServer&)>& func) {
+    std::lock_guard guard(write_mutex_);
+
+    const int published = current_server_.load();
+    func(*servers_[1 - published]);
+    current_server_.store(1 - published);
+    generation_.fetch_add(1);
+
+    // a reader registered in either epoch may still hold the old copy:
+    // drain the idle epoch, move new readers there, then drain the epoch they have left
+    const int epoch = current_epoch_.load();
+    WaitForReaders(1 - epoch);
+    current_epoch_.store(1 - epoch);
+    WaitForReaders(epoch);
+
+    func(*servers_[published]);
+}
+
+void ConcurrentSearchServer::WaitForReaders(int epoch) const {
+    for (const ReadIndicatorSlot& slot : read_indicators_[epoch]) {
+        while (slot.reader_count.load() != 0) {
+            std::this_thread::yield();
+        }
+    }
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "search_server.h"
+
+const size_t READ_INDICATOR_SLOT_COUNT = 64;
+const size_t READ_INDICATOR_SLOT_ALIGNMENT = 64;
+
+// SearchServer that serves queries while documents are added and removed (Left-Right scheme).
+// There are two copies of the index. Readers pin the current generation and read the copy it
+// points to without any lock. A writer changes the idle copy, publishes it as the new generation
+// and waits until every reader that could still see the old copy has left its epoch, only then
+// the old copy is brought up to date and becomes the idle one.
+// Searches never wait for writes, writes wait for the searches already running. The price is
+// the memory of the second copy, every change is applied twice, so it must be deterministic.
+class ConcurrentSearchServer {
+public:
+    template <typename StopWords>
+    explicit ConcurrentSearchServer(const StopWords& stop_words, PostingFormat posting_format = PostingFormat::RAW)
+        : servers_{ std::make_unique<SearchServer>(stop_words, posting_format),
+                    std::make_unique<SearchServer>(stop_words, posting_format) } {
+    }
+
+    ConcurrentSearchServer(const ConcurrentSearchServer&) = delete;
+    ConcurrentSearchServer& operator=(const ConcurrentSearchServer&) = delete;
+
+    // calls func(const SearchServer&) on the current generation and returns its result
+    template <typename Func>
+    auto Read(Func func) const {
+        // leaves the epoch even if func throws
+        struct EpochGuard {
+            std::atomic<int64_t>& reader_count;
+
+            ~EpochGuard() {
+                reader_count.fetch_sub(1);
+            }
+        };
+
+        std::atomic<int64_t>& reader_count = read_indicators_[current_epoch_.load()][GetReadIndicatorSlot()].reader_count;
+        reader_count.fetch_add(1);
+        EpochGuard guard{reader_count};
+        return func(static_cast<const SearchServer&>(*servers_[current_server_.load()]));
+    }
+
+    // calls func(SearchServer&) on both copies, writers are serialized.
+    // If func throws, it must throw before changing the server, as AddDocument does
+    void Update(const std::function<void(SearchServer&)>& func);
+
+    void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
+        Update([&](SearchServer& server) {
+            server.AddDocument(document_id, document, status, ratings);
+        });
+    }
+
+    void RemoveDocument(int document_id) {
+        Update([document_id](SearchServer& server) {
+            server.RemoveDocument(document_id);
+        });
+    }
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+                                           int max_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        return Read([&](const SearchServer& server) {
+            return server.FindTopDocuments(raw_query, status, max_count);
+        });
+    }
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate,
+                                           int max_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        return Read([&](const SearchServer& server) {
+            return server.FindTopDocuments(raw_query, document_predicate, max_count);
+        });
+    }
+
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const {
+        return Read([&](const SearchServer& server) {
+            return server.MatchDocument(raw_query, document_id);
+        });
+    }
+
+    int GetDocumentCount() const {
+        return Read([](const SearchServer& server) {
+            return server.GetDocumentCount();
+        });
+    }
+
+    // number of published changes
+    uint64_t GetGeneration() const {
+        return generation_.load();
+    }
+
+private:
+    struct alignas(READ_INDICATOR_SLOT_ALIGNMENT) ReadIndicatorSlot {
+        std::atomic<int64_t> reader_count{0};
+    };
+    using ReadIndicator = std::array<ReadIndicatorSlot, READ_INDICATOR_SLOT_COUNT>;
+
+    std::array<std::unique_ptr<SearchServer>, 2> servers_;
+    // the copy readers go to
+    std::atomic<int> current_server_{0};
+    // the epoch new readers register in, a writer flips it to wait for the readers of the other one
+    std::atomic<int> current_epoch_{0};
+    mutable std::array<ReadIndicator, 2> read_indicators_;
+    std::atomic<uint64_t> generation_{0};
+    std::mutex write_mutex_;
+
+    // readers of different threads count themselves in different cache lines
+    static size_t GetReadIndicatorSlot() {
+        return std::hash<std::thread::id>{}(std::this_thread::get_id()) % READ_INDICATOR_SLOT_COUNT;
+    }
+
+    void WaitForReaders(int epoch) const;
+};
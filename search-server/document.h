@@ -1,6 +1,8 @@
 #pragma once
 
 #include <iostream>
+#include <string_view>
+#include <vector>
 
 using namespace std::string_literals;
 
@@ -25,6 +27,21 @@ struct Document {
     int rating = 0;
 };
 
+// the top of a search that may be stopped: with is_truncated the search was stopped early
+// and the documents are the top of the documents scanned before that
+struct SearchResult {
+    std::vector<Document> documents;
+    bool is_truncated = false;
+};
+
+// a document for SearchServer::AddDocuments, the text must outlive the call
+struct NewDocument {
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+};
+
 std::ostream& operator<< (std::ostream& os, DocumentStatus status);
 
 std::ostream& operator<< (std::ostream& os, const Document& document);
\ No newline at end of file
@@ -0,0 +1,21 @@
+#include "document_attributes.h"
+
+void DocumentAttributes::Save(SnapshotWriter& writer) const {
+    writer.WriteArray(ids_.data(), ids_.size());
+    writer.WriteArray(ratings_.data(), ratings_.size());
+    writer.WriteArray(statuses_.data(), statuses_.size());
+}
+
+DocumentAttributes DocumentAttributes::Load(SnapshotReader& reader, size_t document_count) {
+    const int* ids = reader.ReadArray<int>(document_count);
+    const int* ratings = reader.ReadArray<int>(document_count);
+    const DocumentStatus* statuses = reader.ReadArray<DocumentStatus>(document_count);
+    DocumentAttributes attributes;
+    for (size_t i = 0; i < document_count; ++i) {
+        if (static_cast<size_t>(statuses[i]) >= DOCUMENT_STATUS_COUNT) {
+            throw std::invalid_argument("Snapshot is truncated or corrupted"s);
+        }
+        attributes.Add(ids[i], ratings[i], statuses[i]);
+    }
+    return attributes;
+}
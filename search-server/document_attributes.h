@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "document.h"
+#include "snapshot.h"
+
+const size_t DOCUMENT_STATUS_COUNT = 4;
+
+// Attributes of the documents by internal document index, each in its own array, and for every status
+// a bitmap of the live documents with it: bit i % 64 of word i / 64 for document index i.
+// A search for one status tests a bit instead of reading the attributes and calling a predicate.
+class DocumentAttributes {
+public:
+    size_t size() const {
+        return ids_.size();
+    }
+
+    // the document gets the next index and is live
+    void Add(int id, int rating, DocumentStatus status) {
+        if (ids_.size() % 64 == 0) {
+            for (std::vector<uint64_t>& bitmap : status_bitmaps_) {
+                bitmap.push_back(0);
+            }
+        }
+        SetBit(status_bitmaps_[static_cast<size_t>(status)], ids_.size());
+        ids_.push_back(id);
+        ratings_.push_back(rating);
+        statuses_.push_back(status);
+    }
+
+    // the attributes are kept, the document leaves the bitmap of its status
+    void Remove(int document_index) {
+        std::vector<uint64_t>& bitmap = status_bitmaps_[static_cast<size_t>(statuses_[document_index])];
+        bitmap[document_index / 64] &= ~(uint64_t{1} << (document_index % 64));
+    }
+
+    int GetId(int document_index) const {
+        return ids_[document_index];
+    }
+
+    int GetRating(int document_index) const {
+        return ratings_[document_index];
+    }
+
+    DocumentStatus GetStatus(int document_index) const {
+        return statuses_[document_index];
+    }
+
+    const uint64_t* GetStatusBitmap(DocumentStatus status) const {
+        return status_bitmaps_[static_cast<size_t>(status)].data();
+    }
+
+    static bool TestBit(const uint64_t* bitmap, int document_index) {
+        return (bitmap[document_index / 64] >> (document_index % 64)) & 1;
+    }
+
+    // ids, ratings and statuses, the bitmaps are restored by Load
+    void Save(SnapshotWriter& writer) const;
+
+    // all the documents are live, removed ones must be removed again
+    static DocumentAttributes Load(SnapshotReader& reader, size_t document_count);
+
+private:
+    std::vector<int> ids_;
+    std::vector<int> ratings_;
+    std::vector<DocumentStatus> statuses_;
+    std::array<std::vector<uint64_t>, DOCUMENT_STATUS_COUNT> status_bitmaps_;
+
+    static void SetBit(std::vector<uint64_t>& bitmap, size_t document_index) {
+        bitmap[document_index / 64] |= uint64_t{1} << (document_index % 64);
+    }
+};
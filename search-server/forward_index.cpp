@@ -0,0 +1,15 @@
+#include "forward_index.h"
+
+ForwardIndex ForwardIndex::Map(SnapshotReader& reader, size_t document_count) {
+    ForwardIndex index;
+    const uint64_t word_count = reader.ReadValue<uint64_t>();
+    index.mapped_document_count_ = document_count;
+    index.mapped_offsets_ = reader.ReadArray<uint64_t>(document_count + 1);
+    index.mapped_term_ids_ = reader.ReadArray<TermId>(word_count);
+    index.mapped_term_freqs_ = reader.ReadArray<double>(word_count);
+    if (index.mapped_offsets_[0] != 0 || index.mapped_offsets_[document_count] != word_count
+        || !std::is_sorted(index.mapped_offsets_, index.mapped_offsets_ + document_count + 1)) {
+        throw std::invalid_argument("Snapshot is truncated or corrupted"s);
+    }
+    return index;
+}
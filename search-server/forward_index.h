@@ -0,0 +1,195 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "snapshot.h"
+#include "term_dictionary.h"
+
+// Words of one document: term ids in ascending order with their term freqs. Points into a ForwardIndex.
+class DocumentWords {
+public:
+    DocumentWords() = default;
+
+    DocumentWords(const TermId* term_ids, const double* term_freqs, size_t size)
+        : term_ids_(term_ids)
+        , term_freqs_(term_freqs)
+        , size_(size) {
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    TermId GetTermId(size_t i) const {
+        return term_ids_[i];
+    }
+
+    double GetTermFreq(size_t i) const {
+        return term_freqs_[i];
+    }
+
+    const TermId* GetTermIds() const {
+        return term_ids_;
+    }
+
+    bool Contains(TermId term_id) const {
+        return std::binary_search(term_ids_, term_ids_ + size_, term_id);
+    }
+
+private:
+    const TermId* term_ids_ = nullptr;
+    const double* term_freqs_ = nullptr;
+    size_t size_ = 0;
+};
+
+// The words of a document with their frequencies as (word, term freq), in the order of term ids.
+// Nothing is copied, the view is valid until the server is changed.
+class WordFrequencies {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::pair<std::string_view, double>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        Iterator(const TermDictionary* dictionary, const DocumentWords* words, size_t position)
+            : dictionary_(dictionary)
+            , words_(words)
+            , position_(position) {
+        }
+
+        value_type operator*() const {
+            return {dictionary_->GetTerm(words_->GetTermId(position_)), words_->GetTermFreq(position_)};
+        }
+
+        Iterator& operator++() {
+            ++position_;
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return position_ == other.position_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return position_ != other.position_;
+        }
+
+    private:
+        const TermDictionary* dictionary_;
+        const DocumentWords* words_;
+        size_t position_;
+    };
+
+    WordFrequencies(const TermDictionary& dictionary, DocumentWords words)
+        : dictionary_(&dictionary)
+        , words_(words) {
+    }
+
+    Iterator begin() const {
+        return {dictionary_, &words_, 0};
+    }
+
+    Iterator end() const {
+        return {dictionary_, &words_, words_.size()};
+    }
+
+    size_t size() const {
+        return words_.size();
+    }
+
+    bool empty() const {
+        return words_.size() == 0;
+    }
+
+private:
+    const TermDictionary* dictionary_;
+    DocumentWords words_;
+};
+
+// Words of all documents by internal document index in three shared arrays (CSR): the words
+// of document i are [offsets[i], offsets[i + 1]) of term ids and term freqs. Documents are only appended.
+// The documents of a snapshot stay in the mapped file, the ones added later are appended after them.
+class ForwardIndex {
+public:
+    size_t GetDocumentCount() const {
+        return mapped_document_count_ + offsets_.size() - 1;
+    }
+
+    // term_freqs are (term id, term freq) pairs in ascending order of term ids
+    template <typename TermFreqs>
+    void AddDocument(const TermFreqs& term_freqs) {
+        for (const auto& [term_id, term_freq] : term_freqs) {
+            term_ids_.push_back(term_id);
+            term_freqs_.push_back(term_freq);
+        }
+        offsets_.push_back(term_ids_.size());
+    }
+
+    DocumentWords GetWords(int document_index) const {
+        const size_t index = static_cast<size_t>(document_index);
+        if (index < mapped_document_count_) {
+            const uint64_t begin = mapped_offsets_[index];
+            return {mapped_term_ids_ + begin, mapped_term_freqs_ + begin, mapped_offsets_[index + 1] - begin};
+        }
+        const size_t own_index = index - mapped_document_count_;
+        return {term_ids_.data() + offsets_[own_index], term_freqs_.data() + offsets_[own_index],
+                offsets_[own_index + 1] - offsets_[own_index]};
+    }
+
+    size_t GetMemoryUsage() const {
+        return offsets_.capacity() * sizeof(uint64_t) + term_ids_.capacity() * sizeof(TermId) + term_freqs_.capacity() * sizeof(double);
+    }
+
+    // the documents with is_removed(document_index) get no words
+    template <typename Predicate>
+    void Save(SnapshotWriter& writer, Predicate is_removed) const;
+
+    // the index refers to the reader's data, which must outlive it
+    static ForwardIndex Map(SnapshotReader& reader, size_t document_count);
+
+private:
+    size_t mapped_document_count_ = 0;
+    const uint64_t* mapped_offsets_ = nullptr;
+    const TermId* mapped_term_ids_ = nullptr;
+    const double* mapped_term_freqs_ = nullptr;
+    // of the documents after the mapped ones
+    std::vector<uint64_t> offsets_ = { 0 };
+    std::vector<TermId> term_ids_;
+    std::vector<double> term_freqs_;
+};
+
+template <typename Predicate>
+void ForwardIndex::Save(SnapshotWriter& writer, Predicate is_removed) const {
+    const size_t document_count = GetDocumentCount();
+    std::vector<uint64_t> offsets(document_count + 1, 0);
+    for (size_t document_index = 0; document_index < document_count; ++document_index) {
+        offsets[document_index + 1] = offsets[document_index]
+                                      + (is_removed(document_index) ? 0 : GetWords(static_cast<int>(document_index)).size());
+    }
+    std::vector<TermId> term_ids;
+    std::vector<double> term_freqs;
+    term_ids.reserve(offsets.back());
+    term_freqs.reserve(offsets.back());
+    for (size_t document_index = 0; document_index < document_count; ++document_index) {
+        if (is_removed(document_index)) {
+            continue;
+        }
+        const DocumentWords words = GetWords(static_cast<int>(document_index));
+        for (size_t i = 0; i < words.size(); ++i) {
+            term_ids.push_back(words.GetTermId(i));
+            term_freqs.push_back(words.GetTermFreq(i));
+        }
+    }
+    writer.WriteValue(static_cast<uint64_t>(term_ids.size()));
+    writer.WriteArray(offsets.data(), offsets.size());
+    writer.WriteArray(term_ids.data(), term_ids.size());
+    writer.WriteArray(term_freqs.data(), term_freqs.size());
+}
@@ -0,0 +1,85 @@
+#include "index_segment.h"
+
+#include <algorithm>
+
+namespace {
+
+struct SegmentSnapshotHeader {
+    int32_t begin_index;
+    int32_t end_index;
+    int32_t document_count;
+    uint64_t term_count;
+};
+
+} // namespace
+
+size_t IndexSegment::GetPostingCount() const {
+    size_t posting_count = 0;
+    for (const auto& [term_id, postings] : postings_) {
+        posting_count += postings.size();
+    }
+    return posting_count;
+}
+
+size_t IndexSegment::GetMemoryUsage() const {
+    // a hash table node holds the list, the next node pointer and the cached hash
+    size_t memory_usage = sizeof(*this) + postings_.bucket_count() * sizeof(void*)
+        + postings_.size() * (sizeof(std::pair<const TermId, PostingList>) + 2 * sizeof(void*));
+    for (const auto& [term_id, postings] : postings_) {
+        memory_usage += postings.GetMemoryUsage() - sizeof(PostingList);
+    }
+    return memory_usage;
+}
+
+void IndexSegment::ShrinkToFit() {
+    for (auto& [term_id, postings] : postings_) {
+        postings.ShrinkToFit();
+    }
+}
+
+void IndexSegment::DropEmptyPostings() {
+    for (auto it = postings_.begin(); it != postings_.end();) {
+        if (it->second.empty()) {
+            it = postings_.erase(it);
+        } else {
+            it->second.ShrinkToFit();
+            ++it;
+        }
+    }
+}
+
+void IndexSegment::Save(SnapshotWriter& writer) const {
+    // in the order of term ids, so the same index gives the same snapshot
+    std::vector<TermId> term_ids;
+    term_ids.reserve(postings_.size());
+    for (const auto& [term_id, postings] : postings_) {
+        term_ids.push_back(term_id);
+    }
+    std::sort(term_ids.begin(), term_ids.end());
+    writer.WriteValue(SegmentSnapshotHeader{begin_index_, end_index_, document_count_, term_ids.size()});
+    writer.WriteArray(term_ids.data(), term_ids.size());
+    for (const TermId term_id : term_ids) {
+        postings_.at(term_id).Save(writer);
+    }
+}
+
+IndexSegment IndexSegment::Map(PostingFormat format, size_t term_count, SnapshotReader& reader) {
+    const SegmentSnapshotHeader& header = reader.ReadValue<SegmentSnapshotHeader>();
+    if (header.begin_index < 0 || header.end_index < header.begin_index || header.document_count < 0
+        || header.document_count > header.end_index - header.begin_index || header.term_count > term_count) {
+        throw std::invalid_argument("Snapshot is truncated or corrupted"s);
+    }
+    const TermId* term_ids = reader.ReadArray<TermId>(header.term_count);
+    IndexSegment segment(format, header.begin_index);
+    segment.end_index_ = header.end_index;
+    segment.document_count_ = header.document_count;
+    segment.postings_.reserve(header.term_count);
+    for (uint64_t i = 0; i < header.term_count; ++i) {
+        // ascending, so every term is listed once
+        if (term_ids[i] < 0 || static_cast<size_t>(term_ids[i]) >= term_count || (i != 0 && term_ids[i] <= term_ids[i - 1])) {
+            throw std::invalid_argument("Snapshot is truncated or corrupted"s);
+        }
+        segment.postings_.emplace(term_ids[i], PostingList::Map(format, reader));
+    }
+    return segment;
+}
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <stdexcept>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "posting_list.h"
+#include "snapshot.h"
+#include "term_dictionary.h"
+
+// the mutable segment is sealed when it gets this many documents
+const int SEGMENT_DOCUMENT_COUNT = 1024;
+// so many sealed segments of one tier are merged into a segment of the next tier
+const int SEGMENT_MERGE_FACTOR = 4;
+
+// Postings of the documents with internal indexes [begin_index, end_index), a list per term id
+// of the terms present in the segment only, so a segment costs its own terms, not the whole dictionary.
+// SearchServer appends to its last, mutable segment only. Sealed segments are never changed,
+// they are replaced by the result of a merge, so a merge may read them from another thread.
+class IndexSegment {
+public:
+    IndexSegment(PostingFormat format, int begin_index)
+        : format_(format)
+        , begin_index_(begin_index)
+        , end_index_(begin_index)
+        , empty_postings_(format) {
+    }
+
+    int GetBeginIndex() const {
+        return begin_index_;
+    }
+
+    int GetEndIndex() const {
+        return end_index_;
+    }
+
+    // documents of the range still present in the segment, merges drop the removed ones
+    int GetDocumentCount() const {
+        return document_count_;
+    }
+
+    // document_index must be the end index of the segment, term_counts are (term id, count) pairs
+    template <typename TermCounts>
+    void AddDocument(int document_index, const TermCounts& term_counts, int document_length);
+
+    // an empty list for a term without postings in the segment
+    const PostingList& GetPostings(TermId term_id) const {
+        const auto it = postings_.find(term_id);
+        return it != postings_.end() ? it->second : empty_postings_;
+    }
+
+    // the terms with postings in the segment, in no particular order: func(term_id, postings)
+    template <typename Func>
+    void ForEachTerm(Func func) const {
+        for (const auto& [term_id, postings] : postings_) {
+            func(term_id, postings);
+        }
+    }
+
+    size_t GetTermCount() const {
+        return postings_.size();
+    }
+
+    size_t GetPostingCount() const;
+
+    size_t GetMemoryUsage() const;
+
+    // before the segment is sealed: the lists release their spare capacity, COMPRESSED ones encode their tails
+    void ShrinkToFit();
+
+    // a segment of the documents [first, last) with indexes from begin_index, each with term_counts
+    // of (term id, count) pairs and length. The postings are grouped by term first, then the list
+    // of every term is filled on its own, in parallel with the parallel policy
+    template <typename ExecutionPolicy, typename DocumentIterator>
+    static IndexSegment Build(ExecutionPolicy&& policy, PostingFormat format, int begin_index,
+                              DocumentIterator first, DocumentIterator last);
+
+    // one segment of the adjacent segments, the documents with is_removed(document_index) are dropped
+    template <typename Predicate>
+    static IndexSegment Merge(const std::vector<std::shared_ptr<const IndexSegment>>& segments, Predicate is_removed);
+
+    // a copy without the documents with is_removed(document_index), term_id becomes new_term_ids[term_id],
+    // the postings of a term mapped to NO_TERM are dropped, they must belong to removed documents only
+    template <typename Predicate>
+    IndexSegment Compact(Predicate is_removed, const std::vector<TermId>& new_term_ids) const;
+
+    void Save(SnapshotWriter& writer) const;
+
+    // the segment refers to the reader's data, which must outlive it. Term ids must be less than term_count
+    static IndexSegment Map(PostingFormat format, size_t term_count, SnapshotReader& reader);
+
+private:
+    PostingFormat format_;
+    int begin_index_;
+    int end_index_;
+    int document_count_ = 0;
+    std::unordered_map<TermId, PostingList> postings_;
+    PostingList empty_postings_;
+
+    PostingList& GetOrAddPostings(TermId term_id) {
+        return postings_.try_emplace(term_id, format_).first->second;
+    }
+
+    // after a merge or a compaction: the lists of removed documents only are dropped, the rest are shrunk
+    void DropEmptyPostings();
+};
+
+template <typename TermCounts>
+void IndexSegment::AddDocument(int document_index, const TermCounts& term_counts, int document_length) {
+    if (document_index != end_index_) {
+        throw std::invalid_argument("Documents are added to a segment in order of their indexes"s);
+    }
+    for (const auto& [term_id, term_count] : term_counts) {
+        GetOrAddPostings(term_id).Add(document_index, term_count, document_length);
+    }
+    ++end_index_;
+    ++document_count_;
+}
+
+template <typename ExecutionPolicy, typename DocumentIterator>
+IndexSegment IndexSegment::Build(ExecutionPolicy&& policy, PostingFormat format, int begin_index,
+                                 DocumentIterator first, DocumentIterator last) {
+    // a counting sort of the postings by term id: those of term_id are [term_offsets[term_id], term_offsets[term_id + 1])
+    TermId max_term_id = NO_TERM;
+    for (DocumentIterator document = first; document != last; ++document) {
+        for (const auto& [term_id, term_count] : document->term_counts) {
+            max_term_id = std::max(max_term_id, term_id);
+        }
+    }
+    std::vector<size_t> term_offsets(max_term_id + 2, 0);
+    for (DocumentIterator document = first; document != last; ++document) {
+        for (const auto& [term_id, term_count] : document->term_counts) {
+            ++term_offsets[term_id + 1];
+        }
+    }
+    std::vector<TermId> term_ids;
+    for (TermId term_id = 0; term_id <= max_term_id; ++term_id) {
+        if (term_offsets[term_id + 1] != 0) {
+            term_ids.push_back(term_id);
+        }
+    }
+    std::partial_sum(term_offsets.begin(), term_offsets.end(), term_offsets.begin());
+
+    struct Posting {
+        int document_index;
+        int term_count;
+        int document_length;
+    };
+    std::vector<Posting> postings(term_offsets.back());
+    std::vector<size_t> positions(term_offsets.begin(), term_offsets.end() - 1);
+    int document_index = begin_index;
+    for (DocumentIterator document = first; document != last; ++document, ++document_index) {
+        for (const auto& [term_id, term_count] : document->term_counts) {
+            postings[positions[term_id]++] = {document_index, term_count, document->length};
+        }
+    }
+
+    std::vector<PostingList> term_postings(term_ids.size(), PostingList(format));
+    std::vector<size_t> term_numbers(term_ids.size());
+    std::iota(term_numbers.begin(), term_numbers.end(), 0);
+    std::for_each(policy, term_numbers.begin(), term_numbers.end(), [&](const size_t term_number) {
+        const TermId term_id = term_ids[term_number];
+        PostingList& list = term_postings[term_number];
+        for (size_t i = term_offsets[term_id]; i < term_offsets[term_id + 1]; ++i) {
+            list.Add(postings[i].document_index, postings[i].term_count, postings[i].document_length);
+        }
+        list.ShrinkToFit();
+    });
+
+    IndexSegment segment(format, begin_index);
+    segment.postings_.reserve(term_ids.size());
+    for (size_t term_number = 0; term_number < term_ids.size(); ++term_number) {
+        segment.postings_.emplace(term_ids[term_number], std::move(term_postings[term_number]));
+    }
+    segment.end_index_ = document_index;
+    segment.document_count_ = document_index - begin_index;
+    return segment;
+}
+
+template <typename Predicate>
+IndexSegment IndexSegment::Merge(const std::vector<std::shared_ptr<const IndexSegment>>& segments, Predicate is_removed) {
+    IndexSegment merged(segments.front()->format_, segments.front()->begin_index_);
+    size_t term_count = 0;
+    for (const auto& segment : segments) {
+        term_count = std::max(term_count, segment->postings_.size());
+    }
+    merged.postings_.reserve(term_count);
+    for (const auto& segment : segments) {
+        for (const auto& [term_id, postings] : segment->postings_) {
+            merged.GetOrAddPostings(term_id).Concat(postings, [&is_removed](const int document_index) {
+                return !is_removed(document_index);
+            });
+        }
+        merged.end_index_ = segment->end_index_;
+    }
+    for (int document_index = merged.begin_index_; document_index < merged.end_index_; ++document_index) {
+        merged.document_count_ += is_removed(document_index) ? 0 : 1;
+    }
+    merged.DropEmptyPostings();
+    return merged;
+}
+
+template <typename Predicate>
+IndexSegment IndexSegment::Compact(Predicate is_removed, const std::vector<TermId>& new_term_ids) const {
+    IndexSegment compacted(format_, begin_index_);
+    compacted.end_index_ = end_index_;
+    compacted.postings_.reserve(postings_.size());
+    for (const auto& [term_id, postings] : postings_) {
+        const TermId new_term_id = new_term_ids[term_id];
+        if (new_term_id == NO_TERM || postings.empty()) {
+            continue;
+        }
+        compacted.GetOrAddPostings(new_term_id).Concat(postings, [&is_removed](const int document_index) {
+            return !is_removed(document_index);
+        });
+    }
+    for (int document_index = begin_index_; document_index < end_index_; ++document_index) {
+        compacted.document_count_ += is_removed(document_index) ? 0 : 1;
+    }
+    compacted.DropEmptyPostings();
+    return compacted;
+}
@@ -0,0 +1,185 @@
+#include "instrumentation.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <thread>
+
+namespace {
+
+struct ProbeCounters {
+    std::atomic<uint64_t> count{0};
+    std::atomic<int64_t> total{0};
+    std::atomic<int64_t> max{0};
+    std::array<std::atomic<uint64_t>, LATENCY_BUCKET_COUNT> latency_counts{};
+};
+
+// The histograms of one thread. A seqlock of its one writer: the generation is -1 while the shard
+// is cleared, a reader takes the counters only if the generation is the same before and after
+struct alignas(64) Shard {
+    std::thread::id owner;
+    std::atomic<int64_t> generation{-1};
+    std::array<ProbeCounters, PROBE_COUNT> probes;
+    // shards are only prepended to the list and never freed
+    Shard* next = nullptr;
+};
+
+std::atomic<Shard*> shards{nullptr};
+// bumped by ResetProbeStats, a shard of an older generation is cleared by its thread
+std::atomic<int64_t> current_generation{0};
+
+Shard& GetShard() {
+    thread_local Shard* thread_shard = nullptr;
+    if (thread_shard != nullptr) {
+        return *thread_shard;
+    }
+    // a thread with the id of an exited one takes over its shard
+    const std::thread::id owner = std::this_thread::get_id();
+    Shard* shard = shards.load(std::memory_order_acquire);
+    while (shard != nullptr && shard->owner != owner) {
+        shard = shard->next;
+    }
+    if (shard == nullptr) {
+        shard = new Shard();
+        shard->owner = owner;
+        shard->next = shards.load(std::memory_order_relaxed);
+        while (!shards.compare_exchange_weak(shard->next, shard, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
+    thread_shard = shard;
+    return *shard;
+}
+
+void ClearShard(Shard& shard, int64_t generation) {
+    shard.generation.store(-1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (ProbeCounters& counters : shard.probes) {
+        counters.count.store(0, std::memory_order_relaxed);
+        counters.total.store(0, std::memory_order_relaxed);
+        counters.max.store(0, std::memory_order_relaxed);
+        for (std::atomic<uint64_t>& count : counters.latency_counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+    shard.generation.store(generation, std::memory_order_release);
+}
+
+// the shard has one writer, so the counters need no read-modify-write
+template <typename Type>
+void AddRelaxed(std::atomic<Type>& counter, Type value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+}
+
+std::string_view GetProbeName(Probe probe) {
+    static const std::array<std::string_view, PROBE_COUNT> names = {
+        "parse", "minus words", "posting scan", "accumulation", "top-k", "result building"
+    };
+    return names[static_cast<size_t>(probe)];
+}
+
+void RecordProbe(Probe probe, std::chrono::nanoseconds duration) {
+    Shard& shard = GetShard();
+    const int64_t generation = current_generation.load(std::memory_order_relaxed);
+    if (shard.generation.load(std::memory_order_relaxed) != generation) {
+        ClearShard(shard, generation);
+    }
+    ProbeCounters& counters = shard.probes[static_cast<size_t>(probe)];
+    AddRelaxed<uint64_t>(counters.count, 1);
+    AddRelaxed<int64_t>(counters.total, duration.count());
+    AddRelaxed<uint64_t>(counters.latency_counts[GetLatencyBucket(duration)], 1);
+    if (duration.count() > counters.max.load(std::memory_order_relaxed)) {
+        counters.max.store(duration.count(), std::memory_order_relaxed);
+    }
+}
+
+std::vector<ProbeStats> GetProbeStats() {
+    struct Sums {
+        uint64_t count = 0;
+        int64_t total = 0;
+        int64_t max = 0;
+        std::array<uint64_t, LATENCY_BUCKET_COUNT> latency_counts{};
+    };
+    std::array<Sums, PROBE_COUNT> sums;
+    const int64_t generation = current_generation.load(std::memory_order_relaxed);
+    for (const Shard* shard = shards.load(std::memory_order_acquire); shard != nullptr; shard = shard->next) {
+        if (shard->generation.load(std::memory_order_acquire) != generation) {
+            continue;
+        }
+        std::array<Sums, PROBE_COUNT> shard_sums;
+        for (size_t probe = 0; probe < PROBE_COUNT; ++probe) {
+            const ProbeCounters& counters = shard->probes[probe];
+            shard_sums[probe].count = counters.count.load(std::memory_order_relaxed);
+            shard_sums[probe].total = counters.total.load(std::memory_order_relaxed);
+            shard_sums[probe].max = counters.max.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < LATENCY_BUCKET_COUNT; ++i) {
+                shard_sums[probe].latency_counts[i] = counters.latency_counts[i].load(std::memory_order_relaxed);
+            }
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        // cleared while it was read
+        if (shard->generation.load(std::memory_order_relaxed) != generation) {
+            continue;
+        }
+        for (size_t probe = 0; probe < PROBE_COUNT; ++probe) {
+            sums[probe].count += shard_sums[probe].count;
+            sums[probe].total += shard_sums[probe].total;
+            sums[probe].max = std::max(sums[probe].max, shard_sums[probe].max);
+            for (size_t i = 0; i < LATENCY_BUCKET_COUNT; ++i) {
+                sums[probe].latency_counts[i] += shard_sums[probe].latency_counts[i];
+            }
+        }
+    }
+
+    std::vector<ProbeStats> stats(PROBE_COUNT);
+    for (size_t probe = 0; probe < PROBE_COUNT; ++probe) {
+        stats[probe].probe = static_cast<Probe>(probe);
+        stats[probe].count = sums[probe].count;
+        stats[probe].total = std::chrono::nanoseconds(sums[probe].total);
+        stats[probe].latencies = ComputeLatencies(sums[probe].latency_counts.data(), std::chrono::nanoseconds(sums[probe].max));
+    }
+    return stats;
+}
+
+void ResetProbeStats() {
+    current_generation.fetch_add(1, std::memory_order_relaxed);
+}
+
+void DumpProbeStats(std::ostream& os) {
+    os << std::left << std::setw(16) << "probe" << std::right << std::setw(10) << "count";
+    for (const std::string_view column : {"total", "p50", "p90", "p99", "max"}) {
+        os << std::setw(11) << column;
+    }
+    os << '\n';
+    for (const ProbeStats& stats : GetProbeStats()) {
+        os << std::left << std::setw(16) << GetProbeName(stats.probe) << std::right << std::setw(10) << stats.count;
+        for (const std::chrono::nanoseconds duration : {stats.total, stats.latencies.p50, stats.latencies.p90,
+                                                        stats.latencies.p99, stats.latencies.max}) {
+            os << std::setw(11) << FormatDuration(duration);
+        }
+        os << '\n';
+    }
+}
+
+std::string FormatDuration(std::chrono::nanoseconds duration) {
+    const int64_t nanoseconds = duration.count();
+    if (nanoseconds < 1000 && nanoseconds > -1000) {
+        return std::to_string(nanoseconds) + " ns";
+    }
+    static const std::array<std::pair<double, const char*>, 3> units = {{{1e3, "us"}, {1e6, "ms"}, {1e9, "s"}}};
+    size_t unit = 0;
+    while (unit + 1 < units.size() && std::abs(nanoseconds) >= units[unit + 1].first) {
+        ++unit;
+    }
+    const double value = nanoseconds / units[unit].first;
+    // three significant digits
+    const int precision = std::abs(value) >= 100 ? 0 : std::abs(value) >= 10 ? 1 : 2;
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.*f %s", precision, value, units[unit].second);
+    return buffer;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "latency_histogram.h"
+
+// Stages of a search timed by SEARCH_PROBE. The probes are compiled only with SEARCH_SERVER_PROBES
+// defined, otherwise SEARCH_PROBE expands to nothing and the search has no timing code at all.
+enum class Probe {
+    // splitting, parsing and resolving the query words
+    PARSE,
+    // excluding the documents of the minus words
+    MINUS_WORDS,
+    // reading the postings of the plus words into the accumulator
+    POSTING_SCAN,
+    // taking the matched documents out of the accumulator through the predicate
+    ACCUMULATION,
+    // sorting or selecting the top documents
+    TOP_K,
+    // joining the documents of segments and slices into one result
+    RESULT_BUILDING,
+};
+
+const size_t PROBE_COUNT = 6;
+
+std::string_view GetProbeName(Probe probe);
+
+struct ProbeStats {
+    Probe probe;
+    uint64_t count = 0;
+    std::chrono::nanoseconds total{0};
+    QueryLatencies latencies;
+};
+
+// Every thread records to its own histograms, so recording takes no lock and never waits for readers
+void RecordProbe(Probe probe, std::chrono::nanoseconds duration);
+
+// of all the threads since the last reset, by probe; a record made at the moment may be missed
+std::vector<ProbeStats> GetProbeStats();
+
+// the histograms start over, each thread clears its own at its next record
+void ResetProbeStats();
+
+// a line per probe with its count, total time and percentiles
+void DumpProbeStats(std::ostream& os);
+
+// in the largest unit that keeps the value at least 1: "950 ns", "12.3 us", "4.56 ms", "1.20 s"
+std::string FormatDuration(std::chrono::nanoseconds duration);
+
+// records the time from its construction to the end of its scope
+class ScopedProbe {
+public:
+    explicit ScopedProbe(Probe probe)
+        : probe_(probe) {
+    }
+
+    ScopedProbe(const ScopedProbe&) = delete;
+    ScopedProbe& operator=(const ScopedProbe&) = delete;
+
+    ~ScopedProbe() {
+        RecordProbe(probe_, Clock::now() - start_time_);
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    const Probe probe_;
+    const Clock::time_point start_time_ = Clock::now();
+};
+
+#define PROBE_CONCAT_INTERNAL(X, Y) X ## Y
+#define PROBE_CONCAT(X, Y) PROBE_CONCAT_INTERNAL(X, Y)
+
+#ifdef SEARCH_SERVER_PROBES
+#define SEARCH_PROBE(probe) ScopedProbe PROBE_CONCAT(probe_guard, __LINE__)(probe)
+#else
+#define SEARCH_PROBE(probe)
+#endif
@@ -0,0 +1,56 @@
+#include "latency_histogram.h"
+
+#include <algorithm>
+
+size_t GetLatencyBucket(std::chrono::nanoseconds latency) {
+    const uint64_t value = std::max<int64_t>(latency.count(), 0);
+    if (value < LATENCY_SUB_BUCKET_COUNT) {
+        return value;
+    }
+    if (value >= uint64_t{1} << LATENCY_MAX_EXPONENT) {
+        return LATENCY_BUCKET_COUNT - 1;
+    }
+    int exponent = 63;
+    while (!(value >> exponent)) {
+        --exponent;
+    }
+    const size_t sub_bucket = (value >> (exponent - LATENCY_SUB_BUCKET_BITS)) & (LATENCY_SUB_BUCKET_COUNT - 1);
+    return (exponent - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKET_COUNT + sub_bucket;
+}
+
+std::chrono::nanoseconds GetLatencyBucketBound(size_t bucket) {
+    if (bucket < LATENCY_SUB_BUCKET_COUNT) {
+        return std::chrono::nanoseconds(bucket);
+    }
+    const int shift = static_cast<int>(bucket / LATENCY_SUB_BUCKET_COUNT) - 1;
+    const uint64_t sub_bucket = bucket % LATENCY_SUB_BUCKET_COUNT;
+    return std::chrono::nanoseconds((LATENCY_SUB_BUCKET_COUNT + sub_bucket) << shift);
+}
+
+QueryLatencies ComputeLatencies(const uint64_t* counts, std::chrono::nanoseconds max_latency) {
+    QueryLatencies latencies;
+    uint64_t total_count = 0;
+    for (size_t bucket = 0; bucket < LATENCY_BUCKET_COUNT; ++bucket) {
+        total_count += counts[bucket];
+    }
+    if (total_count == 0) {
+        return latencies;
+    }
+    const auto get_percentile = [&](const uint64_t percent) {
+        const uint64_t rank = (total_count - 1) * percent / 100;
+        uint64_t count = 0;
+        size_t bucket = 0;
+        while (count + counts[bucket] <= rank) {
+            count += counts[bucket++];
+        }
+        if (bucket + 1 == LATENCY_BUCKET_COUNT) {
+            return max_latency;
+        }
+        return std::min(GetLatencyBucketBound(bucket + 1) - std::chrono::nanoseconds(1), max_latency);
+    };
+    latencies.p50 = get_percentile(50);
+    latencies.p90 = get_percentile(90);
+    latencies.p99 = get_percentile(99);
+    latencies.max = max_latency;
+    return latencies;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Latencies in nanoseconds are counted in log-linear buckets: LATENCY_SUB_BUCKET_COUNT buckets for every
+// power of two, so a bucket is at most 1 / LATENCY_SUB_BUCKET_COUNT of its lower bound wide.
+// Latencies of 2^LATENCY_MAX_EXPONENT ns (about 69 s) and longer share the last bucket.
+const int LATENCY_SUB_BUCKET_BITS = 3;
+const size_t LATENCY_SUB_BUCKET_COUNT = size_t{1} << LATENCY_SUB_BUCKET_BITS;
+const int LATENCY_MAX_EXPONENT = 36;
+const size_t LATENCY_BUCKET_COUNT = (LATENCY_MAX_EXPONENT - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKET_COUNT;
+
+// of the time queries took
+struct QueryLatencies {
+    std::chrono::nanoseconds p50{0};
+    std::chrono::nanoseconds p90{0};
+    std::chrono::nanoseconds p99{0};
+    std::chrono::nanoseconds max{0};
+};
+
+size_t GetLatencyBucket(std::chrono::nanoseconds latency);
+
+// the smallest latency of the bucket
+std::chrono::nanoseconds GetLatencyBucketBound(size_t bucket);
+
+// from counts of LATENCY_BUCKET_COUNT buckets, a percentile is the upper bound of its bucket
+// but not more than the exact maximum
+QueryLatencies ComputeLatencies(const uint64_t* counts, std::chrono::nanoseconds max_latency);
@@ -3,6 +3,7 @@
 #include <chrono>
 #include <iostream>
 
+#include "instrumentation.h"
 #include "search_server.h"
 
 #define PROFILE_CONCAT_INTERNAL(X, Y) X ## Y
@@ -13,6 +14,8 @@
 
 using namespace std::string_literals;
 
+// prints the time of its scope on destruction in ns, us, ms or s, see FormatDuration.
+// For the stages of a search use SEARCH_PROBE, which keeps percentiles and costs nothing when disabled
 class LogDuration {
 public:
 
@@ -22,12 +25,9 @@ public:
 
 
     ~LogDuration() {
-        using namespace std::chrono;
-        using namespace std::literals;
-
         const auto end_time = Clock::now();
-        const auto dur = end_time - start_time_;
-        os << text_ <<  ": "s << duration_cast<milliseconds>(dur).count() << " ms"s << std::endl << std::endl;
+        // no std::endl, a flush would be timed by the next measurement
+        os << text_ << ": "s << FormatDuration(end_time - start_time_) << "\n\n"s;
     }
 
 private:
@@ -0,0 +1,352 @@
+#include "posting_list.h"
+
+namespace {
+
+void WriteVarint(std::vector<uint8_t>& data, uint32_t value) {
+    while (value >= 0x80) {
+        data.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    data.push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t ReadVarint(const uint8_t*& data) {
+    uint32_t value = 0;
+    for (int shift = 0; ; shift += 7) {
+        const uint8_t byte = *data++;
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (byte < 0x80) {
+            return value;
+        }
+    }
+}
+
+} // namespace
+
+void PostingList::Add(int document_id, int term_count, int document_length) {
+    Materialize();
+    if (posting_count_ == 0 || GetBlockLastId(GetBlockCount() - 1) < document_id) {
+        Append(document_id, term_count, document_length);
+        return;
+    }
+
+    // out of order or repeated id, rare enough to pay for a rebuild
+    if (format_ == PostingFormat::COMPRESSED) {
+        std::vector<Entry> entries = DecodeEntries();
+        const auto it = std::lower_bound(entries.begin(), entries.end(), document_id, [](const Entry& entry, int id) {
+            return entry.document_id < id;
+        });
+        if (it != entries.end() && it->document_id == document_id) {
+            *it = {document_id, term_count, document_length};
+        } else {
+            entries.insert(it, {document_id, term_count, document_length});
+        }
+        Rebuild(entries);
+        return;
+    }
+
+    const double term_freq = term_count * (1.0 / document_length);
+    const size_t position = std::lower_bound(document_ids_.begin(), document_ids_.end(), document_id) - document_ids_.begin();
+    if (document_ids_[position] == document_id) {
+        term_freqs_[position] = term_freq;
+    } else {
+        document_ids_.insert(document_ids_.begin() + position, document_id);
+        term_freqs_.insert(term_freqs_.begin() + position, term_freq);
+        ++posting_count_;
+    }
+    RebuildMaxTermFreqs();
+}
+
+void PostingList::ShrinkToFit() {
+    // the list won't grow, so the tail is sealed into a last, shorter block
+    if (format_ == PostingFormat::COMPRESSED && !mapped_ && !document_ids_.empty()) {
+        SealTail();
+    }
+    document_ids_.shrink_to_fit();
+    term_freqs_.shrink_to_fit();
+    tail_term_counts_.shrink_to_fit();
+    tail_document_lengths_.shrink_to_fit();
+    block_last_ids_.shrink_to_fit();
+    block_offsets_.shrink_to_fit();
+    data_.shrink_to_fit();
+    block_max_term_freqs_.shrink_to_fit();
+}
+
+// mapped arrays are counted too, the pages stay resident while the list is queried
+size_t PostingList::GetMemoryUsage() const {
+    return sizeof(*this)
+        + (mapped_ ? mapped_->size : 0)
+        + document_ids_.capacity() * sizeof(int)
+        + term_freqs_.capacity() * sizeof(double)
+        + tail_term_counts_.capacity() * sizeof(int)
+        + tail_document_lengths_.capacity() * sizeof(int)
+        + block_last_ids_.capacity() * sizeof(int)
+        + block_offsets_.capacity() * sizeof(uint32_t)
+        + data_.capacity()
+        + block_max_term_freqs_.capacity() * sizeof(double);
+}
+
+void PostingList::Cursor::Advance(int document_id) {
+    if (GetDocumentId() >= document_id) {
+        return;
+    }
+    if (view_.document_ids[view_.size - 1] < document_id) {
+        LoadBlock(postings_->FindBlock(document_id, block_ + 1));
+    }
+    index_ = std::lower_bound(view_.document_ids + index_, view_.document_ids + view_.size, document_id) - view_.document_ids;
+}
+
+double PostingList::Cursor::GetBlockMaxTermFreq(int document_id) {
+    const size_t block_count = postings_->GetBlockCount();
+    shallow_block_ = std::max(shallow_block_, block_);
+    while (shallow_block_ < block_count && postings_->GetBlockLastId(shallow_block_) < document_id) {
+        ++shallow_block_;
+    }
+    return shallow_block_ < block_count ? postings_->GetBlockMaxTermFreqs()[shallow_block_] : 0.0;
+}
+
+void PostingList::Cursor::LoadBlock(size_t block) {
+    block_ = block;
+    index_ = 0;
+    view_ = block < postings_->GetBlockCount() ? postings_->GetBlock(block, buffer_) : BlockView{};
+}
+
+size_t PostingList::FindBlock(int document_id, size_t from_block) const {
+    size_t low = from_block;
+    size_t high = GetBlockCount();
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        if (GetBlockLastId(middle) < document_id) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+PostingList::BlockView PostingList::GetBlock(size_t block, BlockBuffer& buffer) const {
+    if (format_ == PostingFormat::RAW) {
+        const size_t begin = block * POSTING_BLOCK_SIZE;
+        return {GetRawDocumentIds() + begin, GetRawTermFreqs() + begin, std::min(POSTING_BLOCK_SIZE, GetRawCount() - begin)};
+    }
+    if (block == GetSealedBlockCount()) {
+        return {GetRawDocumentIds(), GetRawTermFreqs(), GetRawCount()};
+    }
+
+    const uint8_t* data = GetData() + GetBlockOffsets()[block];
+    int document_id = block == 0 ? -1 : GetBlockLastIds()[block - 1];
+    const size_t size = GetBlockSize(block);
+    for (size_t i = 0; i < size; ++i) {
+        document_id += static_cast<int>(ReadVarint(data));
+        const uint32_t term_count = ReadVarint(data);
+        const uint32_t document_length = ReadVarint(data);
+        buffer.document_ids[i] = document_id;
+        buffer.term_freqs[i] = term_count * (1.0 / document_length);
+    }
+    return {buffer.document_ids.data(), buffer.term_freqs.data(), size};
+}
+
+void PostingList::Append(int document_id, int term_count, int document_length) {
+    if (format_ == PostingFormat::COMPRESSED && document_ids_.empty() && posting_count_ % POSTING_BLOCK_SIZE != 0) {
+        UnsealLastBlock();
+    }
+    AppendTermFreq(document_id, term_count * (1.0 / document_length));
+    if (format_ == PostingFormat::COMPRESSED) {
+        tail_term_counts_.push_back(term_count);
+        tail_document_lengths_.push_back(document_length);
+        if (document_ids_.size() == POSTING_BLOCK_SIZE) {
+            SealTail();
+        }
+    }
+}
+
+void PostingList::AppendTermFreq(int document_id, double term_freq) {
+    UpdateMaxTermFreq(posting_count_, term_freq);
+    document_ids_.push_back(document_id);
+    term_freqs_.push_back(term_freq);
+    ++posting_count_;
+}
+
+void PostingList::SealTail() {
+    block_offsets_.push_back(static_cast<uint32_t>(data_.size()));
+    int previous_id = block_last_ids_.empty() ? -1 : block_last_ids_.back();
+    for (size_t i = 0; i < document_ids_.size(); ++i) {
+        WriteVarint(data_, static_cast<uint32_t>(document_ids_[i] - previous_id));
+        WriteVarint(data_, static_cast<uint32_t>(tail_term_counts_[i]));
+        WriteVarint(data_, static_cast<uint32_t>(tail_document_lengths_[i]));
+        previous_id = document_ids_[i];
+    }
+    block_last_ids_.push_back(previous_id);
+
+    document_ids_.clear();
+    term_freqs_.clear();
+    tail_term_counts_.clear();
+    tail_document_lengths_.clear();
+}
+
+void PostingList::UnsealLastBlock() {
+    const size_t block = block_last_ids_.size() - 1;
+    const uint8_t* data = data_.data() + block_offsets_[block];
+    int document_id = block == 0 ? -1 : block_last_ids_[block - 1];
+    const size_t size = GetBlockSize(block);
+    for (size_t i = 0; i < size; ++i) {
+        document_id += static_cast<int>(ReadVarint(data));
+        const int term_count = static_cast<int>(ReadVarint(data));
+        const int document_length = static_cast<int>(ReadVarint(data));
+        document_ids_.push_back(document_id);
+        term_freqs_.push_back(term_count * (1.0 / document_length));
+        tail_term_counts_.push_back(term_count);
+        tail_document_lengths_.push_back(document_length);
+    }
+    data_.resize(block_offsets_[block]);
+    block_offsets_.pop_back();
+    block_last_ids_.pop_back();
+}
+
+std::vector<PostingList::Entry> PostingList::DecodeEntries() const {
+    std::vector<Entry> entries;
+    entries.reserve(size());
+    const int* block_last_ids = GetBlockLastIds();
+    for (size_t block = 0; block < GetSealedBlockCount(); ++block) {
+        const uint8_t* data = GetData() + GetBlockOffsets()[block];
+        int document_id = block == 0 ? -1 : block_last_ids[block - 1];
+        const size_t size = GetBlockSize(block);
+        for (size_t i = 0; i < size; ++i) {
+            document_id += static_cast<int>(ReadVarint(data));
+            const int term_count = static_cast<int>(ReadVarint(data));
+            const int document_length = static_cast<int>(ReadVarint(data));
+            entries.push_back({document_id, term_count, document_length});
+        }
+    }
+    const int* tail_document_ids = GetRawDocumentIds();
+    const int* tail_term_counts = GetTailTermCounts();
+    const int* tail_document_lengths = GetTailDocumentLengths();
+    for (size_t i = 0; i < GetRawCount(); ++i) {
+        entries.push_back({tail_document_ids[i], tail_term_counts[i], tail_document_lengths[i]});
+    }
+    return entries;
+}
+
+void PostingList::Rebuild(const std::vector<Entry>& entries) {
+    *this = PostingList(format_);
+    for (const Entry& entry : entries) {
+        Append(entry.document_id, entry.term_count, entry.document_length);
+    }
+    data_.shrink_to_fit();
+    block_last_ids_.shrink_to_fit();
+    block_offsets_.shrink_to_fit();
+}
+
+void PostingList::UpdateMaxTermFreq(size_t position, double term_freq) {
+    const size_t block = position / POSTING_BLOCK_SIZE;
+    if (block == block_max_term_freqs_.size()) {
+        block_max_term_freqs_.push_back(term_freq);
+    } else {
+        block_max_term_freqs_[block] = std::max(block_max_term_freqs_[block], term_freq);
+    }
+    max_term_freq_ = std::max(max_term_freq_, term_freq);
+}
+
+void PostingList::RebuildMaxTermFreqs() {
+    block_max_term_freqs_.clear();
+    max_term_freq_ = 0;
+    for (size_t i = 0; i < term_freqs_.size(); ++i) {
+        UpdateMaxTermFreq(i, term_freqs_[i]);
+    }
+    block_max_term_freqs_.shrink_to_fit();
+}
+
+void PostingList::Save(SnapshotWriter& writer) const {
+    const size_t raw_count = GetRawCount();
+    const size_t block_count = GetSealedBlockCount();
+    const size_t data_size = mapped_ ? mapped_->data_size : data_.size();
+    const size_t tail_count = format_ == PostingFormat::COMPRESSED ? raw_count : 0;
+
+    SnapshotHeader header = {};
+    size_t offset = sizeof(SnapshotHeader);
+    const auto place = [&offset](uint64_t& array_offset, size_t array_size) {
+        offset = SnapshotWriter::AlignUp(offset);
+        array_offset = offset;
+        offset += array_size;
+    };
+    place(header.document_ids_offset, raw_count * sizeof(int));
+    place(header.term_freqs_offset, raw_count * sizeof(double));
+    place(header.tail_term_counts_offset, tail_count * sizeof(int));
+    place(header.tail_document_lengths_offset, tail_count * sizeof(int));
+    place(header.block_last_ids_offset, block_count * sizeof(int));
+    place(header.block_offsets_offset, block_count * sizeof(uint32_t));
+    place(header.data_offset, data_size);
+    place(header.block_max_term_freqs_offset, GetBlockCount() * sizeof(double));
+    header.size = SnapshotWriter::AlignUp(offset);
+    header.posting_count = posting_count_;
+    header.max_term_freq = max_term_freq_;
+    header.raw_count = raw_count;
+    header.block_count = block_count;
+    header.data_size = data_size;
+
+    const size_t begin = writer.GetPosition();
+    writer.WriteValue(header);
+    writer.WriteArray(GetRawDocumentIds(), raw_count);
+    writer.WriteArray(GetRawTermFreqs(), raw_count);
+    writer.WriteArray(GetTailTermCounts(), tail_count);
+    writer.WriteArray(GetTailDocumentLengths(), tail_count);
+    writer.WriteArray(GetBlockLastIds(), block_count);
+    writer.WriteArray(GetBlockOffsets(), block_count);
+    writer.WriteArray(GetData(), data_size);
+    writer.WriteArray(GetBlockMaxTermFreqs(), GetBlockCount());
+    if (writer.GetPosition() - begin != header.size) {
+        throw std::logic_error("Posting list snapshot layout mismatch"s);
+    }
+}
+
+PostingList PostingList::Map(PostingFormat format, SnapshotReader& reader) {
+    const SnapshotHeader& header = reader.ReadValue<SnapshotHeader>();
+    const auto fits = [&header](uint64_t offset, uint64_t count, size_t element_size) {
+        return offset % SNAPSHOT_ALIGNMENT == 0 && offset >= sizeof(SnapshotHeader) && offset <= header.size
+            && count <= (header.size - offset) / element_size;
+    };
+    const size_t tail_count = format == PostingFormat::COMPRESSED ? header.raw_count : 0;
+    const bool is_consistent = header.size >= sizeof(SnapshotHeader) && header.posting_count <= header.size
+        && (format == PostingFormat::RAW ? header.raw_count == header.posting_count && header.block_count == 0
+                                         : header.raw_count < POSTING_BLOCK_SIZE
+                                           && (header.raw_count == 0
+                                               ? (header.posting_count + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE == header.block_count
+                                               : header.block_count * POSTING_BLOCK_SIZE + header.raw_count == header.posting_count))
+        && fits(header.document_ids_offset, header.raw_count, sizeof(int))
+        && fits(header.term_freqs_offset, header.raw_count, sizeof(double))
+        && fits(header.tail_term_counts_offset, tail_count, sizeof(int))
+        && fits(header.tail_document_lengths_offset, tail_count, sizeof(int))
+        && fits(header.block_last_ids_offset, header.block_count, sizeof(int))
+        && fits(header.block_offsets_offset, header.block_count, sizeof(uint32_t))
+        && fits(header.data_offset, header.data_size, 1)
+        && fits(header.block_max_term_freqs_offset, (header.posting_count + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE, sizeof(double));
+    if (!is_consistent) {
+        throw std::invalid_argument("Snapshot is truncated or corrupted"s);
+    }
+    reader.Skip(header.size - sizeof(SnapshotHeader));
+
+    PostingList postings(format);
+    postings.mapped_ = &header;
+    postings.posting_count_ = header.posting_count;
+    postings.max_term_freq_ = header.max_term_freq;
+    return postings;
+}
+
+void PostingList::Materialize() {
+    if (!mapped_) {
+        return;
+    }
+    const size_t raw_count = GetRawCount();
+    document_ids_.assign(GetRawDocumentIds(), GetRawDocumentIds() + raw_count);
+    term_freqs_.assign(GetRawTermFreqs(), GetRawTermFreqs() + raw_count);
+    if (format_ == PostingFormat::COMPRESSED) {
+        tail_term_counts_.assign(GetTailTermCounts(), GetTailTermCounts() + raw_count);
+        tail_document_lengths_.assign(GetTailDocumentLengths(), GetTailDocumentLengths() + raw_count);
+        block_last_ids_.assign(GetBlockLastIds(), GetBlockLastIds() + mapped_->block_count);
+        block_offsets_.assign(GetBlockOffsets(), GetBlockOffsets() + mapped_->block_count);
+        data_.assign(GetData(), GetData() + mapped_->data_size);
+    }
+    block_max_term_freqs_.assign(GetBlockMaxTermFreqs(), GetBlockMaxTermFreqs() + GetBlockCount());
+    mapped_ = nullptr;
+}
@@ -0,0 +1,337 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "snapshot.h"
+
+const size_t POSTING_BLOCK_SIZE = 64;
+const int POSTING_END_ID = INT_MAX;
+
+enum class PostingFormat {
+    RAW,
+    COMPRESSED,
+};
+
+// Postings of one term sorted by document id. SearchServer stores its internal document indexes here,
+// they grow with every AddDocument, so adding is an append. Lists are never removed from:
+// SearchServer drops the postings of removed documents when it merges or compacts segments.
+//
+// Every POSTING_BLOCK_SIZE postings form a block with a known maximum term frequency,
+// which lets a query skip blocks that can't change its top.
+// RAW keeps ids and term frequencies in two flat arrays (SoA). COMPRESSED seals every full block
+// into bytes: varint id deltas, term counts and document lengths, term frequency is restored
+// as count * (1.0 / length), exactly as AddDocument computes it. Only the last, not yet full
+// block stays raw until ShrinkToFit seals it as a shorter block, the next Add opens it again.
+// Both formats are read block by block.
+// A list mapped from a snapshot reads its arrays right from the file, they are copied
+// into the own vectors only when the list is modified.
+class PostingList {
+private:
+    struct BlockView {
+        const int* document_ids = nullptr;
+        const double* term_freqs = nullptr;
+        size_t size = 0;
+    };
+
+    // a decoded COMPRESSED block, kept by value so that scanning a list allocates nothing
+    struct BlockBuffer {
+        std::array<int, POSTING_BLOCK_SIZE> document_ids;
+        std::array<double, POSTING_BLOCK_SIZE> term_freqs;
+    };
+
+public:
+    // walks the live postings in ascending id order, decodes one block at a time
+    class Cursor {
+    public:
+        explicit Cursor(const PostingList& postings)
+            : postings_(&postings) {
+            LoadBlock(0);
+        }
+
+        // a copy reads its own buffer
+        Cursor(const Cursor& other)
+            : postings_(other.postings_)
+            , block_(other.block_)
+            , index_(other.index_)
+            , shallow_block_(other.shallow_block_)
+            , view_(other.view_)
+            , buffer_(other.buffer_) {
+            RebaseView(other);
+        }
+
+        Cursor& operator=(const Cursor& other) {
+            postings_ = other.postings_;
+            block_ = other.block_;
+            index_ = other.index_;
+            shallow_block_ = other.shallow_block_;
+            view_ = other.view_;
+            buffer_ = other.buffer_;
+            RebaseView(other);
+            return *this;
+        }
+
+        // POSTING_END_ID after the last posting
+        int GetDocumentId() const {
+            return index_ < view_.size ? view_.document_ids[index_] : POSTING_END_ID;
+        }
+
+        double GetTermFreq() const {
+            return view_.term_freqs[index_];
+        }
+
+        void Next() {
+            if (++index_ == view_.size) {
+                LoadBlock(block_ + 1);
+            }
+        }
+
+        // moves to the first posting with id >= document_id, whole blocks are skipped undecoded
+        void Advance(int document_id);
+
+        // an upper bound of term freq of document_id without moving the cursor, 0 past the last block
+        double GetBlockMaxTermFreq(int document_id);
+
+    private:
+        const PostingList* postings_;
+        size_t block_ = 0;
+        size_t index_ = 0;
+        size_t shallow_block_ = 0;
+        BlockView view_;
+        BlockBuffer buffer_;
+
+        void LoadBlock(size_t block);
+
+        void RebaseView(const Cursor& other) {
+            if (view_.document_ids == other.buffer_.document_ids.data()) {
+                view_.document_ids = buffer_.document_ids.data();
+                view_.term_freqs = buffer_.term_freqs.data();
+            }
+        }
+    };
+
+    explicit PostingList(PostingFormat format = PostingFormat::RAW)
+        : format_(format) {
+    }
+
+    // term frequency of the posting is term_count * (1.0 / document_length)
+    void Add(int document_id, int term_count, int document_length);
+
+    void Save(SnapshotWriter& writer) const;
+
+    // the list refers to the reader's data, which must outlive it
+    static PostingList Map(PostingFormat format, SnapshotReader& reader);
+
+    // appends the postings of other with is_kept(document_id), their ids must be greater than the ids of the list
+    template <typename Predicate>
+    void Concat(const PostingList& other, Predicate is_kept);
+
+    // releases the spare capacity of a list that won't grow anymore
+    void ShrinkToFit();
+
+    size_t size() const {
+        return posting_count_;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    PostingFormat GetFormat() const {
+        return format_;
+    }
+
+    double GetMaxTermFreq() const {
+        return max_term_freq_;
+    }
+
+    size_t GetMemoryUsage() const;
+
+    Cursor GetCursor() const {
+        return Cursor(*this);
+    }
+
+    template <typename Func>
+    void ForEach(Func func) const {
+        ForEach(0, POSTING_END_ID, func);
+    }
+
+    // only the postings with first_id <= document id < last_id
+    template <typename Func>
+    void ForEach(int first_id, int last_id, Func func) const;
+
+private:
+    struct Entry {
+        int document_id;
+        int term_count;
+        int document_length;
+    };
+
+    // offsets are counted from the beginning of the header
+    struct SnapshotHeader {
+        uint64_t size;
+        uint64_t posting_count;
+        double max_term_freq;
+        uint64_t raw_count;
+        uint64_t block_count;
+        uint64_t data_size;
+        uint64_t document_ids_offset;
+        uint64_t term_freqs_offset;
+        uint64_t tail_term_counts_offset;
+        uint64_t tail_document_lengths_offset;
+        uint64_t block_last_ids_offset;
+        uint64_t block_offsets_offset;
+        uint64_t data_offset;
+        uint64_t block_max_term_freqs_offset;
+    };
+
+    PostingFormat format_;
+    // RAW: all postings, COMPRESSED: the tail that is not sealed into a block
+    std::vector<int> document_ids_;
+    std::vector<double> term_freqs_;
+    // COMPRESSED only
+    std::vector<int> tail_term_counts_;
+    std::vector<int> tail_document_lengths_;
+    std::vector<int> block_last_ids_;
+    std::vector<uint32_t> block_offsets_;
+    std::vector<uint8_t> data_;
+    size_t posting_count_ = 0;
+    std::vector<double> block_max_term_freqs_;
+    double max_term_freq_ = 0;
+    // not null while the arrays are read from a snapshot
+    const SnapshotHeader* mapped_ = nullptr;
+
+    template <typename T>
+    const T* GetMapped(uint64_t offset) const {
+        return reinterpret_cast<const T*>(reinterpret_cast<const char*>(mapped_) + offset);
+    }
+
+    // RAW: all postings, COMPRESSED: the tail
+    size_t GetRawCount() const {
+        return mapped_ ? mapped_->raw_count : document_ids_.size();
+    }
+
+    const int* GetRawDocumentIds() const {
+        return mapped_ ? GetMapped<int>(mapped_->document_ids_offset) : document_ids_.data();
+    }
+
+    const double* GetRawTermFreqs() const {
+        return mapped_ ? GetMapped<double>(mapped_->term_freqs_offset) : term_freqs_.data();
+    }
+
+    const int* GetTailTermCounts() const {
+        return mapped_ ? GetMapped<int>(mapped_->tail_term_counts_offset) : tail_term_counts_.data();
+    }
+
+    const int* GetTailDocumentLengths() const {
+        return mapped_ ? GetMapped<int>(mapped_->tail_document_lengths_offset) : tail_document_lengths_.data();
+    }
+
+    // COMPRESSED only, the sealed blocks
+    size_t GetSealedBlockCount() const {
+        return mapped_ ? mapped_->block_count : block_last_ids_.size();
+    }
+
+    const int* GetBlockLastIds() const {
+        return mapped_ ? GetMapped<int>(mapped_->block_last_ids_offset) : block_last_ids_.data();
+    }
+
+    const uint32_t* GetBlockOffsets() const {
+        return mapped_ ? GetMapped<uint32_t>(mapped_->block_offsets_offset) : block_offsets_.data();
+    }
+
+    const uint8_t* GetData() const {
+        return mapped_ ? GetMapped<uint8_t>(mapped_->data_offset) : data_.data();
+    }
+
+    const double* GetBlockMaxTermFreqs() const {
+        return mapped_ ? GetMapped<double>(mapped_->block_max_term_freqs_offset) : block_max_term_freqs_.data();
+    }
+
+    size_t GetBlockCount() const {
+        return (posting_count_ + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE;
+    }
+
+    // only the last block may be shorter
+    size_t GetBlockSize(size_t block) const {
+        return std::min(POSTING_BLOCK_SIZE, posting_count_ - block * POSTING_BLOCK_SIZE);
+    }
+
+    int GetBlockLastId(size_t block) const {
+        if (block < GetSealedBlockCount()) {
+            return GetBlockLastIds()[block];
+        }
+        return format_ == PostingFormat::RAW
+            ? GetRawDocumentIds()[std::min(GetRawCount(), (block + 1) * POSTING_BLOCK_SIZE) - 1]
+            : GetRawDocumentIds()[GetRawCount() - 1];
+    }
+
+    // copies the mapped arrays into the own vectors before a modification
+    void Materialize();
+
+    // the first block at or after from_block that may contain document_id
+    size_t FindBlock(int document_id, size_t from_block = 0) const;
+
+    // a COMPRESSED sealed block is decoded into the buffer
+    BlockView GetBlock(size_t block, BlockBuffer& buffer) const;
+
+    void Append(int document_id, int term_count, int document_length);
+
+    void AppendTermFreq(int document_id, double term_freq);
+
+    void SealTail();
+
+    // COMPRESSED: decodes a shorter last block back into the tail
+    void UnsealLastBlock();
+
+    std::vector<Entry> DecodeEntries() const;
+
+    void Rebuild(const std::vector<Entry>& entries);
+
+    void UpdateMaxTermFreq(size_t position, double term_freq);
+
+    void RebuildMaxTermFreqs();
+};
+
+template <typename Func>
+void PostingList::ForEach(int first_id, int last_id, Func func) const {
+    BlockBuffer buffer;
+    const size_t block_count = GetBlockCount();
+    for (size_t block = FindBlock(first_id); block < block_count; ++block) {
+        const BlockView view = GetBlock(block, buffer);
+        size_t i = view.document_ids[0] >= first_id ? 0
+            : std::lower_bound(view.document_ids, view.document_ids + view.size, first_id) - view.document_ids;
+        for (; i < view.size; ++i) {
+            if (view.document_ids[i] >= last_id) {
+                return;
+            }
+            func(view.document_ids[i], view.term_freqs[i]);
+        }
+    }
+}
+
+template <typename Predicate>
+void PostingList::Concat(const PostingList& other, Predicate is_kept) {
+    if (other.format_ != format_) {
+        throw std::invalid_argument("Posting lists of different formats"s);
+    }
+    Materialize();
+    if (format_ == PostingFormat::COMPRESSED) {
+        for (const Entry& entry : other.DecodeEntries()) {
+            if (is_kept(entry.document_id)) {
+                Append(entry.document_id, entry.term_count, entry.document_length);
+            }
+        }
+        return;
+    }
+    other.ForEach([&](const int document_id, const double term_freq) {
+        if (is_kept(document_id)) {
+            AppendTermFreq(document_id, term_freq);
+        }
+    });
+}
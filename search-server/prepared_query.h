@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "query_context.h"
+
+// A query parsed by SearchServer::Prepare: its unique plus and minus words, their term ids and IDF.
+// The IDF depend on the documents, so they are valid for the index version they were computed for.
+// A search with an outdated query resolves its words again, the text is never parsed again.
+// Like QueryContext, a prepared query is used by one thread at a time.
+class PreparedQuery {
+public:
+    uint64_t GetIndexVersion() const {
+        return index_version_;
+    }
+
+    // sorted unique words of the query, without stop words
+    const std::vector<std::string>& GetPlusWords() const {
+        return words_.plus_words;
+    }
+
+    const std::vector<std::string>& GetMinusWords() const {
+        return words_.minus_words;
+    }
+
+private:
+    friend class SearchServer;
+
+    struct QueryWords {
+        std::vector<std::string> plus_words;
+        std::vector<std::string> minus_words;
+    };
+
+    QueryWords words_;
+    ResolvedQuery query_;
+    uint64_t index_version_ = 0;
+};
@@ -1,17 +1,126 @@
 #include "process_queries.h"
 
+namespace {
+
+QueryLatencies ComputeLatencies(std::vector<std::chrono::nanoseconds> durations) {
+    QueryLatencies latencies;
+    if (durations.empty()) {
+        return latencies;
+    }
+    const auto get_percentile = [&durations](const size_t percent) {
+        const auto nth = durations.begin() + (durations.size() - 1) * percent / 100;
+        std::nth_element(durations.begin(), nth, durations.end());
+        return *nth;
+    };
+    latencies.p50 = get_percentile(50);
+    latencies.p90 = get_percentile(90);
+    latencies.p99 = get_percentile(99);
+    latencies.max = *std::max_element(durations.begin(), durations.end());
+    return latencies;
+}
+
+// a long query would hold one thread, its slices are scored by idle ones instead
+std::vector<Document> FindTopDocuments(QueryExecutor& executor, const SearchServer& search_server, const std::string& query) {
+    thread_local std::vector<std::string_view> words;
+    SplitIntoWords(query, words);
+    if (words.size() >= PARALLEL_QUERY_WORD_COUNT) {
+        return search_server.FindTopDocuments(executor, query);
+    }
+    return search_server.FindTopDocuments(query);
+}
+
+} // namespace
+
 std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_server,
                                                   const std::vector<std::string>& queries) {
-    std::vector <std::vector<Document>> result(queries.size());
-    std::transform(std::execution::par, queries.begin(), queries.end(), result.begin(), [&search_server](const std::string_view query) {
-                                                                    return search_server.FindTopDocuments(query);});
-    return result;
+    return ProcessQueries(GetDefaultQueryExecutor(), search_server, queries);
 }
 
-std::list<Document> ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries) {
-    std::list<Document> result;
-    for (auto& documents : ProcessQueries(search_server, queries)) {
-        result.insert(result.end(), std::make_move_iterator(documents.begin()), std::make_move_iterator(documents.end()));
+std::vector<std::vector<Document>> ProcessQueries(QueryExecutor& executor, const SearchServer& search_server,
+                                                  const std::vector<std::string>& queries, QueryLatencies* latencies) {
+    std::vector<std::vector<Document>> result(queries.size());
+    std::vector<std::chrono::nanoseconds> durations(queries.size());
+    executor.ParallelFor(queries.size(), [&](const size_t i) {
+        const auto start = std::chrono::steady_clock::now();
+        result[i] = FindTopDocuments(executor, search_server, queries[i]);
+        durations[i] = std::chrono::steady_clock::now() - start;
+    });
+    if (latencies != nullptr) {
+        *latencies = ComputeLatencies(std::move(durations));
     }
     return result;
-}
\ No newline at end of file
+}
+
+void ProcessQueriesStreamed(QueryExecutor& executor, const SearchServer& search_server, const std::vector<std::string>& queries,
+                            const std::function<void(size_t, const std::vector<Document>&)>& sink,
+                            QueryLatencies* latencies) {
+    // results by query index % window size, the ones of [next_query, next_query + window size)
+    std::vector<std::vector<Document>> window(std::min(queries.size(), STREAMED_QUERY_WINDOW_SIZE));
+    std::vector<bool> is_ready(window.size(), false);
+    size_t next_query = 0;
+    bool is_emitting = false;
+    bool is_failed = false;
+    std::mutex mutex;
+    std::condition_variable has_room;
+    std::vector<std::chrono::nanoseconds> durations(latencies != nullptr ? queries.size() : 0);
+
+    // indexes are taken in order, so the oldest running query never waits and the window always moves
+    executor.ParallelFor(queries.size(), [&](const size_t i) {
+        try {
+            {
+                std::unique_lock lock(mutex);
+                has_room.wait(lock, [&] {
+                    return i < next_query + window.size() || is_failed;
+                });
+                if (is_failed) {
+                    return;
+                }
+            }
+            const auto start = std::chrono::steady_clock::now();
+            std::vector<Document> documents = FindTopDocuments(executor, search_server, queries[i]);
+            if (latencies != nullptr) {
+                durations[i] = std::chrono::steady_clock::now() - start;
+            }
+
+            std::unique_lock lock(mutex);
+            window[i % window.size()] = std::move(documents);
+            is_ready[i % window.size()] = true;
+            if (is_emitting) {
+                return;
+            }
+            // whoever completes a query passes on the ready ones, the sink is called outside the lock
+            is_emitting = true;
+            while (next_query < queries.size() && is_ready[next_query % window.size()] && !is_failed) {
+                const size_t query_index = next_query++;
+                is_ready[query_index % window.size()] = false;
+                const std::vector<Document> ready_documents = std::move(window[query_index % window.size()]);
+                has_room.notify_all();
+                lock.unlock();
+                sink(query_index, ready_documents);
+                lock.lock();
+            }
+            is_emitting = false;
+        } catch (...) {
+            std::lock_guard guard(mutex);
+            is_failed = true;
+            has_room.notify_all();
+            throw;
+        }
+    });
+    if (latencies != nullptr) {
+        *latencies = ComputeLatencies(std::move(durations));
+    }
+}
+
+JoinedResults ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries) {
+    return ProcessQueriesJoined(GetDefaultQueryExecutor(), search_server, queries);
+}
+
+JoinedResults ProcessQueriesJoined(QueryExecutor& executor, const SearchServer& search_server,
+                                   const std::vector<std::string>& queries, QueryLatencies* latencies) {
+    JoinedResults results;
+    ProcessQueriesStreamed(executor, search_server, queries, [&results](size_t, const std::vector<Document>& documents) {
+        results.Append(documents);
+    }, latencies);
+    return results;
+}
@@ -1,12 +1,79 @@
 #pragma once
 
 #include <algorithm>
+#include <chrono>
 #include <execution>
-#include <list>
+#include <functional>
 #include <iterator>
 
+#include "latency_histogram.h"
+#include "paginator.h"
+#include "query_executor.h"
 #include "search_server.h"
 
+// a query of at least so many words is also split across the threads of the executor
+const size_t PARALLEL_QUERY_WORD_COUNT = 16;
+
+// at most so many results of a streamed batch are held at once, queries further ahead wait
+const size_t STREAMED_QUERY_WINDOW_SIZE = 256;
+
 std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_server, const std::vector<std::string>& queries);
 
-std::list<Document> ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries); 
\ No newline at end of file
+// every query is a task of the executor, the latencies of the batch are filled if given,
+// exact ones from the start of the search of a query to its result
+std::vector<std::vector<Document>> ProcessQueries(QueryExecutor& executor, const SearchServer& search_server,
+                                                  const std::vector<std::string>& queries, QueryLatencies* latencies = nullptr);
+
+// The results of a batch of queries one after another in one buffer, iterated as one flat range
+// of documents. The results of query i are [offsets[i], offsets[i + 1]) of the buffer.
+class JoinedResults {
+public:
+    using const_iterator = std::vector<Document>::const_iterator;
+
+    const_iterator begin() const {
+        return documents_.begin();
+    }
+
+    const_iterator end() const {
+        return documents_.end();
+    }
+
+    size_t size() const {
+        return documents_.size();
+    }
+
+    bool empty() const {
+        return documents_.empty();
+    }
+
+    size_t GetQueryCount() const {
+        return offsets_.size() - 1;
+    }
+
+    IteratorRange<const_iterator> GetQueryResults(size_t query_index) const {
+        return IteratorRange(documents_.begin() + offsets_.at(query_index), documents_.begin() + offsets_.at(query_index + 1));
+    }
+
+    // the results of the next query
+    void Append(const std::vector<Document>& documents) {
+        documents_.insert(documents_.end(), documents.begin(), documents.end());
+        offsets_.push_back(documents_.size());
+    }
+
+private:
+    std::vector<Document> documents_;
+    std::vector<size_t> offsets_ = { 0 };
+};
+
+// sink(query_index, documents) gets the results of every query in the order of the queries,
+// as soon as the query and all the ones before it are done. Only the results not passed
+// to the sink yet are kept, at most STREAMED_QUERY_WINDOW_SIZE of them. The sink is called
+// by one thread at a time, the first exception of a query or the sink stops the batch and is rethrown
+void ProcessQueriesStreamed(QueryExecutor& executor, const SearchServer& search_server, const std::vector<std::string>& queries,
+                            const std::function<void(size_t, const std::vector<Document>&)>& sink,
+                            QueryLatencies* latencies = nullptr);
+
+JoinedResults ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries);
+
+JoinedResults ProcessQueriesJoined(QueryExecutor& executor, const SearchServer& search_server,
+                                   const std::vector<std::string>& queries, QueryLatencies* latencies = nullptr);
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "document.h"
+#include "relevance_accumulator.h"
+#include "term_dictionary.h"
+#include "top_documents.h"
+
+// plus terms with their IDF and minus terms of a query, the words missing in the index are left out
+struct ResolvedQuery {
+    std::vector<std::pair<TermId, double>> plus_terms;
+    std::vector<TermId> minus_terms;
+};
+
+// Scratch buffers of SearchServer::FindTopDocuments(context, ...): the words of the query, its terms,
+// the relevance accumulator and the top. They only grow, so once they are large enough for the queries
+// and the index, a search allocates nothing. A context may be reused for any server, but by one thread at a time.
+class QueryContext {
+public:
+    QueryContext() = default;
+
+    // the result of the last search
+    const std::vector<Document>& GetDocuments() const {
+        return documents_;
+    }
+
+private:
+    friend class SearchServer;
+
+    struct QueryWords {
+        std::vector<std::string_view> plus_words;
+        std::vector<std::string_view> minus_words;
+    };
+
+    std::vector<std::string_view> words_;
+    QueryWords query_words_;
+    ResolvedQuery query_;
+    RelevanceAccumulator accumulator_;
+    TopDocuments top_{0};
+    std::vector<Document> documents_;
+};
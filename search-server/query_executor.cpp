@@ -0,0 +1,120 @@
+#include "query_executor.h"
+
+namespace {
+
+// the pool and the index of the worker the current thread belongs to
+thread_local const QueryExecutor* current_executor = nullptr;
+thread_local size_t current_worker = 0;
+
+} // namespace
+
+QueryExecutor::QueryExecutor(size_t thread_count) {
+    if (thread_count == 0) {
+        throw std::invalid_argument("Executor needs at least one thread"s);
+    }
+    for (size_t i = 0; i < thread_count; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads_.emplace_back([this, i] {
+            current_executor = this;
+            current_worker = i;
+            RunWorker(i);
+        });
+    }
+}
+
+QueryExecutor::~QueryExecutor() {
+    {
+        std::lock_guard guard(mutex_);
+        is_stopping_ = true;
+    }
+    has_tasks_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+}
+
+void QueryExecutor::Submit(std::function<void()> task) {
+    size_t worker_index = GetCurrentWorker();
+    if (worker_index == workers_.size()) {
+        worker_index = next_worker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    }
+    {
+        // counted under the same lock as published, so a worker that takes the task decrements after the increment
+        std::lock_guard guard(mutex_);
+        std::lock_guard worker_guard(workers_[worker_index]->mutex);
+        workers_[worker_index]->tasks.push_back(std::move(task));
+        ++pending_count_;
+    }
+    has_tasks_.notify_one();
+}
+
+bool QueryExecutor::TryRunTask(size_t worker_index) {
+    std::function<void()> task;
+    for (size_t i = 0; i < workers_.size() && !task; ++i) {
+        Worker& worker = *workers_[(worker_index + i) % workers_.size()];
+        std::lock_guard guard(worker.mutex);
+        if (worker.tasks.empty()) {
+            continue;
+        }
+        // the own newest task is likely still in cache, a stolen one is the oldest
+        if (i == 0) {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+        } else {
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+        }
+    }
+    if (!task) {
+        return false;
+    }
+    {
+        std::lock_guard guard(mutex_);
+        --pending_count_;
+    }
+    task();
+    return true;
+}
+
+void QueryExecutor::RunWorker(size_t worker_index) {
+    while (true) {
+        if (TryRunTask(worker_index)) {
+            continue;
+        }
+        std::unique_lock lock(mutex_);
+        has_tasks_.wait(lock, [this] {
+            return pending_count_ != 0 || is_stopping_;
+        });
+        if (pending_count_ == 0 && is_stopping_) {
+            return;
+        }
+    }
+}
+
+size_t QueryExecutor::GetCurrentWorker() const {
+    return current_executor == this ? current_worker : workers_.size();
+}
+
+void QueryExecutor::Job::Run() {
+    for (size_t index = next_index.fetch_add(1); index < count; index = next_index.fetch_add(1)) {
+        try {
+            func(index);
+        } catch (...) {
+            std::lock_guard guard(mutex);
+            if (!exception) {
+                exception = std::current_exception();
+            }
+        }
+        if (done_count.fetch_add(1) + 1 == count) {
+            std::lock_guard guard(mutex);
+            is_done.notify_all();
+        }
+    }
+}
+
+QueryExecutor& GetDefaultQueryExecutor() {
+    static QueryExecutor executor;
+    return executor;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::string_literals;
+
+// A fixed pool of threads, each with its own deque of tasks. A thread takes the newest task of its own
+// deque and steals the oldest one of another deque when its own is empty. Tasks submitted from a thread
+// of the pool go to its own deque, the rest are spread round robin.
+class QueryExecutor {
+public:
+    explicit QueryExecutor(size_t thread_count = std::max(1u, std::thread::hardware_concurrency()));
+
+    QueryExecutor(const QueryExecutor&) = delete;
+    QueryExecutor& operator=(const QueryExecutor&) = delete;
+
+    // runs the tasks already submitted, then joins the threads
+    ~QueryExecutor();
+
+    size_t GetThreadCount() const {
+        return threads_.size();
+    }
+
+    void Submit(std::function<void()> task);
+
+    // calls func(i) for every i in [0, count) and returns when all calls are done. The calling thread
+    // takes indexes too, so a task of the pool may call it without waiting for a free thread.
+    // The first exception thrown by func is rethrown here
+    template <typename Func>
+    void ParallelFor(size_t count, Func func);
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    // indexes of one ParallelFor, claimed one by one by the caller and the helper tasks
+    struct Job {
+        std::function<void(size_t)> func;
+        size_t count;
+        std::atomic<size_t> next_index{0};
+        std::atomic<size_t> done_count{0};
+        std::mutex mutex;
+        std::condition_variable is_done;
+        std::exception_ptr exception;
+
+        void Run();
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable has_tasks_;
+    // tasks in the deques, guarded by mutex_. Submit takes mutex_ before a worker mutex, nothing takes them the other way
+    size_t pending_count_ = 0;
+    bool is_stopping_ = false;
+    std::atomic<size_t> next_worker_{0};
+
+    bool TryRunTask(size_t worker_index);
+
+    void RunWorker(size_t worker_index);
+
+    // the index of the calling thread in this pool or the number of threads for a foreign thread
+    size_t GetCurrentWorker() const;
+};
+
+template <typename Func>
+void QueryExecutor::ParallelFor(size_t count, Func func) {
+    if (count == 0) {
+        return;
+    }
+    if (count == 1) {
+        func(0);
+        return;
+    }
+    auto job = std::make_shared<Job>();
+    job->func = std::move(func);
+    job->count = count;
+    // a helper which starts after all indexes are taken returns at once
+    const size_t helper_count = std::min(count - 1, GetThreadCount());
+    for (size_t i = 0; i < helper_count; ++i) {
+        Submit([job] {
+            job->Run();
+        });
+    }
+    job->Run();
+
+    std::unique_lock lock(job->mutex);
+    job->is_done.wait(lock, [&job] {
+        return job->done_count.load() == job->count;
+    });
+    if (job->exception) {
+        std::rethrow_exception(job->exception);
+    }
+}
+
+// the executor ProcessQueries runs on, with a thread per core
+QueryExecutor& GetDefaultQueryExecutor();
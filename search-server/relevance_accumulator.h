@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+
+// Sums relevance of documents with internal indexes in [begin_index, end_index) in flat arrays.
+// Every slice of the index space gets its own accumulator, so parallel workers never share one.
+class RelevanceAccumulator {
+public:
+    RelevanceAccumulator() = default;
+
+    RelevanceAccumulator(int begin_index, int end_index)
+        : begin_index_(begin_index)
+        , relevances_(end_index - begin_index, 0.0)
+        , states_(end_index - begin_index, State::UNTOUCHED) {
+    }
+
+    // starts over for another range, the memory is reused
+    void Reset(int begin_index, int end_index) {
+        begin_index_ = begin_index;
+        relevances_.assign(end_index - begin_index, 0.0);
+        states_.assign(end_index - begin_index, State::UNTOUCHED);
+        matched_.clear();
+    }
+
+    // the document will never be matched, whatever is added to it. Called before the adds to the document
+    void Exclude(int document_index) {
+        states_[document_index - begin_index_] = State::EXCLUDED;
+    }
+
+    void Add(int document_index, double relevance) {
+        const int slot = document_index - begin_index_;
+        if (states_[slot] == State::UNTOUCHED) {
+            states_[slot] = State::MATCHED;
+            matched_.push_back(slot);
+        }
+        // an excluded document is summed too but never reported, so there is no branch on it
+        relevances_[slot] += relevance;
+    }
+
+    // calls func(document_index, relevance) in the order documents were first matched
+    template <typename Func>
+    void ForEachMatched(Func func) const {
+        for (const int slot : matched_) {
+            func(begin_index_ + slot, relevances_[slot]);
+        }
+    }
+
+    size_t GetMatchedCount() const {
+        return matched_.size();
+    }
+
+private:
+    enum class State : char {
+        UNTOUCHED,
+        MATCHED,
+        EXCLUDED,
+    };
+
+    int begin_index_ = 0;
+    std::vector<double> relevances_;
+    std::vector<State> states_;
+    std::vector<int> matched_;
+};
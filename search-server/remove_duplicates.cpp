@@ -1,21 +1,183 @@
 #include "remove_duplicates.h"
 
-void RemoveDuplicates(SearchServer& server) {
-    std::set<std::set<std::string_view>> unique_docs_words;
-    std::vector<int> delete_list;
-    for (const int id : server) {
-        std::set<std::string_view> docs_words;
-        for (const auto& [word, _] : server.GetWordFrequencies(id)) {
-            docs_words.insert(word);
-        }
-        if (unique_docs_words.count(docs_words)) {
-            delete_list.push_back(id);
+namespace {
+
+// splitmix64 finalizer
+uint64_t MixHash(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// two independent 64-bit hashes of the sorted term ids
+std::pair<uint64_t, uint64_t> GetFingerprint(const DocumentWords& words) {
+    uint64_t low = MixHash(words.size());
+    uint64_t high = MixHash(~static_cast<uint64_t>(words.size()));
+    for (size_t i = 0; i < words.size(); ++i) {
+        const uint64_t term_id = static_cast<uint64_t>(words.GetTermId(i));
+        low = MixHash(low ^ term_id);
+        high = MixHash(high + term_id * 0x9e3779b97f4a7c15ULL);
+    }
+    return {low, high};
+}
+
+bool HaveSameTerms(const DocumentWords& lhs, const DocumentWords& rhs) {
+    return std::equal(lhs.GetTermIds(), lhs.GetTermIds() + lhs.size(), rhs.GetTermIds(), rhs.GetTermIds() + rhs.size());
+}
+
+double ComputeJaccard(const DocumentWords& lhs, const DocumentWords& rhs) {
+    if (lhs.size() == 0 && rhs.size() == 0) {
+        return 1;
+    }
+    size_t common_count = 0;
+    for (size_t i = 0, j = 0; i < lhs.size() && j < rhs.size();) {
+        if (lhs.GetTermId(i) < rhs.GetTermId(j)) {
+            ++i;
+        } else if (rhs.GetTermId(j) < lhs.GetTermId(i)) {
+            ++j;
+        } else {
+            ++common_count;
+            ++i;
+            ++j;
+        }
+    }
+    return static_cast<double>(common_count) / (lhs.size() + rhs.size() - common_count);
+}
+
+// positions of the documents which are not duplicates yet, their candidate pairs come from
+// the LSH bands of MinHash signatures and are checked with the exact Jaccard similarity
+void FindNearDuplicates(const std::vector<int>& ids, const std::vector<DocumentWords>& documents_words,
+                        std::vector<bool>& is_duplicate, const DeduplicationOptions& options,
+                        std::vector<DuplicateDocument>& duplicates) {
+    std::vector<size_t> positions;
+    for (size_t position = 0; position < ids.size(); ++position) {
+        if (!is_duplicate[position]) {
+            positions.push_back(position);
+        }
+    }
+    const size_t minhash_count = options.minhash_count;
+    std::vector<uint64_t> seeds(minhash_count);
+    for (size_t k = 0; k < minhash_count; ++k) {
+        seeds[k] = MixHash(k + 1);
+    }
+
+    std::vector<uint64_t> signatures(positions.size() * minhash_count, std::numeric_limits<uint64_t>::max());
+    std::vector<size_t> candidates(positions.size());
+    std::iota(candidates.begin(), candidates.end(), 0);
+    std::for_each(std::execution::par, candidates.begin(), candidates.end(), [&](const size_t candidate) {
+        uint64_t* signature = signatures.data() + candidate * minhash_count;
+        const DocumentWords& words = documents_words[positions[candidate]];
+        for (size_t i = 0; i < words.size(); ++i) {
+            const uint64_t term_hash = MixHash(static_cast<uint64_t>(words.GetTermId(i)));
+            for (size_t k = 0; k < minhash_count; ++k) {
+                signature[k] = std::min(signature[k], MixHash(term_hash ^ seeds[k]));
+            }
+        }
+    });
+
+    // (earlier candidate, later candidate) sharing at least one band
+    std::vector<std::pair<size_t, size_t>> pairs;
+    const size_t row_count = minhash_count / options.band_count;
+    std::vector<std::pair<uint64_t, size_t>> band_keys(positions.size());
+    for (int band = 0; band < options.band_count; ++band) {
+        std::transform(std::execution::par, candidates.begin(), candidates.end(), band_keys.begin(), [&](const size_t candidate) {
+            const uint64_t* rows = signatures.data() + candidate * minhash_count + band * row_count;
+            uint64_t band_hash = MixHash(band);
+            for (size_t row = 0; row < row_count; ++row) {
+                band_hash = MixHash(band_hash ^ rows[row]);
+            }
+            return std::pair{band_hash, candidate};
+        });
+        std::sort(std::execution::par, band_keys.begin(), band_keys.end());
+        for (auto group_begin = band_keys.begin(); group_begin != band_keys.end();) {
+            const auto group_end = std::find_if(group_begin, band_keys.end(), [&](const auto& key) {
+                return key.first != group_begin->first;
+            });
+            for (auto later = group_begin; later != group_end; ++later) {
+                for (auto earlier = group_begin; earlier != later; ++earlier) {
+                    pairs.push_back({earlier->second, later->second});
+                }
+            }
+            group_begin = group_end;
+        }
+    }
+    // by the later document, so the earlier one is already known to be kept or removed
+    std::sort(std::execution::par, pairs.begin(), pairs.end(), [](const auto& lhs, const auto& rhs) {
+        return std::tie(lhs.second, lhs.first) < std::tie(rhs.second, rhs.first);
+    });
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+    std::vector<double> similarities(pairs.size());
+    std::transform(std::execution::par, pairs.begin(), pairs.end(), similarities.begin(), [&](const auto& pair) {
+        return ComputeJaccard(documents_words[positions[pair.first]], documents_words[positions[pair.second]]);
+    });
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        const size_t original = positions[pairs[i].first];
+        const size_t duplicate = positions[pairs[i].second];
+        if (similarities[i] >= options.jaccard_threshold && !is_duplicate[original] && !is_duplicate[duplicate]) {
+            is_duplicate[duplicate] = true;
+            duplicates.push_back({ids[duplicate], ids[original], similarities[i]});
+        }
+    }
+}
+
+}
+
+std::vector<DuplicateDocument> RemoveDuplicates(SearchServer& server, const DeduplicationOptions& options) {
+    if (options.near_duplicates) {
+        if (!(options.jaccard_threshold > 0 && options.jaccard_threshold <= 1)) {
+            throw std::invalid_argument("Jaccard threshold must be in (0, 1]"s);
+        }
+        if (options.band_count <= 0 || options.minhash_count < options.band_count
+            || options.minhash_count % options.band_count != 0) {
+            throw std::invalid_argument("MinHash count must be a positive multiple of the band count"s);
+        }
+    }
+
+    const std::vector<int> ids(server.begin(), server.end());
+    std::vector<DocumentWords> documents_words(ids.size());
+    std::transform(std::execution::par, ids.begin(), ids.end(), documents_words.begin(), [&server](const int id) {
+        return server.GetDocumentWords(id);
+    });
+
+    // (fingerprint, position), positions follow ids in ascending order
+    std::vector<std::pair<std::pair<uint64_t, uint64_t>, size_t>> fingerprints(ids.size());
+    std::vector<size_t> positions(ids.size());
+    std::iota(positions.begin(), positions.end(), 0);
+    std::transform(std::execution::par, positions.begin(), positions.end(), fingerprints.begin(), [&](const size_t position) {
+        return std::pair{GetFingerprint(documents_words[position]), position};
+    });
+    std::sort(std::execution::par, fingerprints.begin(), fingerprints.end());
+
+    std::vector<DuplicateDocument> duplicates;
+    std::vector<bool> is_duplicate(ids.size(), false);
+    for (size_t i = 1, original = 0; i < fingerprints.size(); ++i) {
+        const size_t position = fingerprints[i].second;
+        const size_t original_position = fingerprints[original].second;
+        // the words are compared as well, so a collision of fingerprints removes nothing
+        if (fingerprints[i].first == fingerprints[original].first
+            && HaveSameTerms(documents_words[position], documents_words[original_position])) {
+            is_duplicate[position] = true;
+            duplicates.push_back({ids[position], ids[original_position], 1});
         } else {
-            unique_docs_words.insert(docs_words);
+            original = i;
         }
     }
-    for (const int id : delete_list) {
-        std::cout << "Found duplicate document id "s << id << std::endl;
-        server.RemoveDocument(id);
+
+    if (options.near_duplicates) {
+        FindNearDuplicates(ids, documents_words, is_duplicate, options, duplicates);
+    }
+
+    std::sort(duplicates.begin(), duplicates.end(), [](const DuplicateDocument& lhs, const DuplicateDocument& rhs) {
+        return lhs.id < rhs.id;
+    });
+    std::vector<int> duplicate_ids;
+    for (const DuplicateDocument& duplicate : duplicates) {
+        duplicate_ids.push_back(duplicate.id);
     }
-}
\ No newline at end of file
+    server.RemoveDocuments(std::execution::par, duplicate_ids);
+    return duplicates;
+}
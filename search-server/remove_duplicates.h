@@ -1,5 +1,28 @@
 #pragma once
 
+#include <vector>
+
 #include "search_server.h"
 
-void RemoveDuplicates(SearchServer& server);
\ No newline at end of file
+// a document removed as a duplicate of a kept one with a lower id
+struct DuplicateDocument {
+    int id;
+    int original_id;
+    // Jaccard similarity of the word sets, 1 for an exact duplicate
+    double similarity;
+};
+
+struct DeduplicationOptions {
+    // exact duplicates only, or also documents with the Jaccard similarity of at least jaccard_threshold
+    bool near_duplicates = false;
+    double jaccard_threshold = 0.8;
+    // MinHash signature length, split into LSH bands of minhash_count / band_count values;
+    // documents sharing a band are compared exactly, more bands find more pairs at a lower similarity
+    int minhash_count = 64;
+    int band_count = 16;
+};
+
+// Documents with the same set of words as a document with a lower id are removed by one
+// RemoveDocuments after all of them are found. Exact duplicates are found by a 128-bit fingerprint
+// of the sorted term ids, near duplicates by MinHash with LSH banding. Returns the removed documents by id.
+std::vector<DuplicateDocument> RemoveDuplicates(SearchServer& server, const DeduplicationOptions& options = {});
@@ -1,53 +1,55 @@
 #pragma once
+#include <chrono>
+#include <string>
 #include <vector>
-#include <stack>
 
+#include "request_statistics.h"
 #include "search_server.h"
 
+// Searches of the server with statistics of the requests over the last window of time. AddFindRequest
+// may be called from many threads at once while the server isn't changed, the statistics never block it.
 class RequestQueue {
 public:
-    RequestQueue() = default;
-    explicit RequestQueue(const SearchServer& search_server)
-    :server_(search_server){}
+    explicit RequestQueue(const SearchServer& search_server,
+                          RequestStatistics::Clock::duration window = std::chrono::hours(24))
+    :server_(search_server), statistics_(window){}
 
     template <typename DocumentPredicate>
-    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate);
+    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
+        return Record([&] {
+            return server_.FindTopDocuments(raw_query, document_predicate);
+        });
+    }
 
-    std::vector<Document> AddFindRequest(const std::string& raw_query, 
+    std::vector<Document> AddFindRequest(const std::string& raw_query,
                                                         DocumentStatus status = DocumentStatus::ACTUAL) {
-            return AddFindRequest(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-                                                        return document_status == status;});
+        return Record([&] {
+            return server_.FindTopDocuments(raw_query, status);
+        });
     }
 
     int GetNoResultRequests() const {
-        return empty_queries_;
+        return static_cast<int>(statistics_.GetStats().no_result_count);
+    }
+
+    RequestStats GetStats() const {
+        return statistics_.GetStats();
+    }
+
+    // over the last window, rounded up to 1 / REQUEST_WINDOW_BUCKET_COUNT of the window of the queue
+    RequestStats GetStats(RequestStatistics::Clock::duration window) const {
+        return statistics_.GetStats(window);
     }
 
 private:
-    struct QueryResult {
-        uint64_t query_time;
-        int result_count;
-    };
-    std::deque<QueryResult> requests_;
-    const static int min_in_day_ = 1440;
     const SearchServer& server_;
-    int empty_queries_ = 0;
-    uint64_t current_time_ = 0;
-}; 
-
-template <typename DocumentPredicate>
-std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
-    ++current_time_;
-    while (!requests_.empty() && (current_time_ - requests_.front().query_time >= min_in_day_)) {
-        if (requests_.front().result_count == 0) {
-            --empty_queries_;
-        }
-        requests_.pop_front();
-    }
-    auto result = server_.FindTopDocuments(raw_query, document_predicate);
-    requests_.push_back({current_time_, static_cast<int>(result.size())});
-    if (result.empty()) {
-        ++empty_queries_;
+    RequestStatistics statistics_;
+
+    template <typename Search>
+    std::vector<Document> Record(Search search) {
+        const auto start_time = RequestStatistics::Clock::now();
+        std::vector<Document> result = search();
+        statistics_.Record(result.size(), RequestStatistics::Clock::now() - start_time);
+        return result;
     }
-    return result;
-}
+};
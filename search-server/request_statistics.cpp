@@ -0,0 +1,129 @@
+#include "request_statistics.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+using namespace std::string_literals;
+
+namespace {
+
+std::atomic<uint64_t> next_statistics_id{1};
+
+}
+
+RequestStatistics::RequestStatistics(Clock::duration window)
+    : bucket_duration_(window / REQUEST_WINDOW_BUCKET_COUNT)
+    , start_time_(Clock::now())
+    , id_(next_statistics_id.fetch_add(1, std::memory_order_relaxed)) {
+    if (bucket_duration_ <= Clock::duration::zero()) {
+        throw std::invalid_argument("Request statistics window is too short"s);
+    }
+}
+
+RequestStatistics::~RequestStatistics() {
+    for (Shard* shard = shards_.load(std::memory_order_acquire); shard != nullptr;) {
+        Shard* next = shard->next;
+        delete shard;
+        shard = next;
+    }
+}
+
+void RequestStatistics::Record(size_t result_count, std::chrono::nanoseconds latency) {
+    const int64_t epoch = GetEpoch(Clock::now());
+    Bucket& bucket = GetShard().buckets[epoch % REQUEST_WINDOW_BUCKET_COUNT];
+    if (bucket.epoch.load(std::memory_order_relaxed) != epoch) {
+        bucket.epoch.store(-1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bucket.request_count.store(0, std::memory_order_relaxed);
+        bucket.no_result_count.store(0, std::memory_order_relaxed);
+        bucket.max_latency.store(0, std::memory_order_relaxed);
+        for (std::atomic<uint64_t>& count : bucket.latency_counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+        bucket.epoch.store(epoch, std::memory_order_release);
+    }
+    // the shard has one writer, so the counters need no read-modify-write
+    const auto increment = [](std::atomic<uint64_t>& counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    };
+    increment(bucket.request_count);
+    if (result_count == 0) {
+        increment(bucket.no_result_count);
+    }
+    increment(bucket.latency_counts[GetLatencyBucket(latency)]);
+    if (latency.count() > bucket.max_latency.load(std::memory_order_relaxed)) {
+        bucket.max_latency.store(latency.count(), std::memory_order_relaxed);
+    }
+}
+
+RequestStats RequestStatistics::GetStats(Clock::duration window) const {
+    const int64_t bucket_count = std::clamp<int64_t>((window + bucket_duration_ - Clock::duration(1)) / bucket_duration_,
+                                                     1, REQUEST_WINDOW_BUCKET_COUNT);
+    const Clock::duration elapsed = Clock::now() - start_time_;
+    const int64_t last_epoch = elapsed / bucket_duration_;
+    const int64_t first_epoch = last_epoch - bucket_count + 1;
+
+    RequestStats stats;
+    std::array<uint64_t, LATENCY_BUCKET_COUNT> latency_counts{};
+    int64_t max_latency = 0;
+    for (const Shard* shard = shards_.load(std::memory_order_acquire); shard != nullptr; shard = shard->next) {
+        for (const Bucket& bucket : shard->buckets) {
+            const int64_t epoch = bucket.epoch.load(std::memory_order_acquire);
+            if (epoch < first_epoch || epoch > last_epoch) {
+                continue;
+            }
+            const uint64_t request_count = bucket.request_count.load(std::memory_order_relaxed);
+            const uint64_t no_result_count = bucket.no_result_count.load(std::memory_order_relaxed);
+            const int64_t bucket_max_latency = bucket.max_latency.load(std::memory_order_relaxed);
+            std::array<uint64_t, LATENCY_BUCKET_COUNT> bucket_latency_counts;
+            for (size_t i = 0; i < LATENCY_BUCKET_COUNT; ++i) {
+                bucket_latency_counts[i] = bucket.latency_counts[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            // reset for a newer time while it was read
+            if (bucket.epoch.load(std::memory_order_relaxed) != epoch) {
+                continue;
+            }
+            stats.request_count += request_count;
+            stats.no_result_count += no_result_count;
+            max_latency = std::max(max_latency, bucket_max_latency);
+            for (size_t i = 0; i < LATENCY_BUCKET_COUNT; ++i) {
+                latency_counts[i] += bucket_latency_counts[i];
+            }
+        }
+    }
+
+    stats.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::min(elapsed, (bucket_count - 1) * bucket_duration_ + elapsed % bucket_duration_));
+    if (stats.duration > Clock::duration::zero()) {
+        stats.requests_per_second = stats.request_count / std::chrono::duration<double>(stats.duration).count();
+    }
+    stats.latencies = ComputeLatencies(latency_counts.data(), std::chrono::nanoseconds(max_latency));
+    return stats;
+}
+
+RequestStatistics::Shard& RequestStatistics::GetShard() {
+    // most threads record to one statistics
+    thread_local uint64_t cached_id = 0;
+    thread_local Shard* cached_shard = nullptr;
+    if (cached_id == id_) {
+        return *cached_shard;
+    }
+    // a thread with the id of an exited one takes over its shard
+    const std::thread::id owner = std::this_thread::get_id();
+    Shard* shard = shards_.load(std::memory_order_acquire);
+    while (shard != nullptr && shard->owner != owner) {
+        shard = shard->next;
+    }
+    if (shard == nullptr) {
+        shard = new Shard();
+        shard->owner = owner;
+        shard->next = shards_.load(std::memory_order_relaxed);
+        while (!shards_.compare_exchange_weak(shard->next, shard, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
+    cached_id = id_;
+    cached_shard = shard;
+    return *shard;
+}
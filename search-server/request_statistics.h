@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include "latency_histogram.h"
+
+// the window of statistics slides by 1 / REQUEST_WINDOW_BUCKET_COUNT of its duration
+const size_t REQUEST_WINDOW_BUCKET_COUNT = 32;
+
+struct RequestStats {
+    // the time the stats are over: the window, but not more than the time since the statistics were made
+    std::chrono::nanoseconds duration{0};
+    uint64_t request_count = 0;
+    uint64_t no_result_count = 0;
+    double requests_per_second = 0;
+    QueryLatencies latencies;
+};
+
+// Counts of requests over a sliding window of steady clock time, recorded from any number of threads.
+// Every thread writes only to its own shard: a ring of REQUEST_WINDOW_BUCKET_COUNT time buckets of counters
+// and a latency histogram. A bucket is reused for a newer time once its time has left the window.
+// Record takes no lock and doesn't wait for readers, GetStats sums the shards on the calling thread
+// and may miss the requests being recorded at the moment.
+class RequestStatistics {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit RequestStatistics(Clock::duration window = std::chrono::hours(24));
+
+    RequestStatistics(const RequestStatistics&) = delete;
+    RequestStatistics& operator=(const RequestStatistics&) = delete;
+
+    ~RequestStatistics();
+
+    Clock::duration GetWindow() const {
+        return bucket_duration_ * REQUEST_WINDOW_BUCKET_COUNT;
+    }
+
+    void Record(size_t result_count, std::chrono::nanoseconds latency);
+
+    RequestStats GetStats() const {
+        return GetStats(GetWindow());
+    }
+
+    // over the last window, rounded up to whole buckets and at most the window of the statistics
+    RequestStats GetStats(Clock::duration window) const;
+
+private:
+    // A seqlock of one writer: the epoch is -1 while the bucket is reset,
+    // a reader takes the counters only if the epoch is the same before and after
+    struct Bucket {
+        std::atomic<int64_t> epoch{-1};
+        std::atomic<uint64_t> request_count{0};
+        std::atomic<uint64_t> no_result_count{0};
+        std::atomic<int64_t> max_latency{0};
+        std::array<std::atomic<uint64_t>, LATENCY_BUCKET_COUNT> latency_counts{};
+    };
+
+    struct alignas(64) Shard {
+        std::thread::id owner;
+        std::array<Bucket, REQUEST_WINDOW_BUCKET_COUNT> buckets;
+        // shards are only prepended to the list and live as long as the statistics
+        Shard* next = nullptr;
+    };
+
+    Clock::duration bucket_duration_;
+    Clock::time_point start_time_;
+    // unique among all the statistics of the process, so a cached shard of a destroyed one isn't taken
+    uint64_t id_;
+    std::atomic<Shard*> shards_{nullptr};
+
+    // time since the start in bucket durations
+    int64_t GetEpoch(Clock::time_point time) const {
+        return (time - start_time_) / bucket_duration_;
+    }
+
+    Shard& GetShard();
+};
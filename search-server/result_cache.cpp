@@ -0,0 +1,84 @@
+#include "result_cache.h"
+
+ResultCache::ResultCache(const SearchServer& search_server, size_t capacity)
+    : server_(search_server)
+    , shard_capacity_(std::max<size_t>(1, capacity / RESULT_CACHE_SHARD_COUNT))
+    , shards_(RESULT_CACHE_SHARD_COUNT) {
+}
+
+std::vector<Document> ResultCache::FindTopDocuments(const std::string_view raw_query, DocumentStatus status, int max_count) {
+    // the buffers of the key and the search only grow, so a hit allocates just the copy of the result
+    thread_local QueryContext context;
+    thread_local std::string key;
+    MakeKey(context, raw_query, status, max_count, key);
+    const uint64_t index_version = server_.GetIndexVersion();
+    Shard& shard = GetShard(key);
+    {
+        std::lock_guard guard(shard.mutex);
+        const auto it = shard.index.find(key);
+        if (it != shard.index.end() && it->second->index_version == index_version) {
+            ++shard.hit_count;
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            return it->second->documents;
+        }
+        ++shard.miss_count;
+    }
+
+    // searched without the lock, a concurrent miss of the same key just computes it twice
+    std::vector<Document> documents = server_.FindTopDocuments(context, raw_query, status, max_count);
+
+    std::lock_guard guard(shard.mutex);
+    const auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        it->second->index_version = index_version;
+        it->second->documents = documents;
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        return documents;
+    }
+    if (shard.entries.size() >= shard_capacity_) {
+        shard.index.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+    }
+    shard.entries.push_front({key, index_version, documents});
+    shard.index.emplace(shard.entries.front().key, shard.entries.begin());
+    return documents;
+}
+
+uint64_t ResultCache::GetHitCount() const {
+    uint64_t hit_count = 0;
+    for (const Shard& shard : shards_) {
+        std::lock_guard guard(shard.mutex);
+        hit_count += shard.hit_count;
+    }
+    return hit_count;
+}
+
+uint64_t ResultCache::GetMissCount() const {
+    uint64_t miss_count = 0;
+    for (const Shard& shard : shards_) {
+        std::lock_guard guard(shard.mutex);
+        miss_count += shard.miss_count;
+    }
+    return miss_count;
+}
+
+size_t ResultCache::size() const {
+    size_t entry_count = 0;
+    for (const Shard& shard : shards_) {
+        std::lock_guard guard(shard.mutex);
+        entry_count += shard.entries.size();
+    }
+    return entry_count;
+}
+
+void ResultCache::MakeKey(QueryContext& context, const std::string_view raw_query, DocumentStatus status, int max_count,
+                          std::string& key) const {
+    key = std::to_string(static_cast<int>(status));
+    key += ' ';
+    key += std::to_string(max_count);
+    server_.NormalizeQuery(context, raw_query, key);
+}
+
+ResultCache::Shard& ResultCache::GetShard(const std::string& key) {
+    return shards_[std::hash<std::string>{}(key) % shards_.size()];
+}
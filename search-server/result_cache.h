@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "search_server.h"
+
+const size_t RESULT_CACHE_SHARD_COUNT = 16;
+const size_t RESULT_CACHE_SHARD_ALIGNMENT = 64;
+
+// Thread-safe LRU cache of FindTopDocuments results for a server. Queries are normalized, so word order,
+// repeated words and stop words don't matter: the key is the sorted unique plus and minus words,
+// the status and the number of documents. The key is made without dictionary lookups or IDF, the query terms
+// are resolved only on a miss. Keys are spread over shards, each with its own lock and LRU list.
+// An entry is valid only for the index version it was computed for. Every added or removed document
+// changes the document count and so the IDF of every term, so a change of the index outdates all entries,
+// outdated ones count as misses and are replaced.
+// The server must not be changed while a search is running, as with SearchServer itself.
+class ResultCache {
+public:
+    ResultCache(const SearchServer& search_server, size_t capacity);
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+                                           int max_count = MAX_RESULT_DOCUMENT_COUNT);
+
+    uint64_t GetHitCount() const;
+
+    uint64_t GetMissCount() const;
+
+    size_t size() const;
+
+private:
+    struct Entry {
+        std::string key;
+        uint64_t index_version;
+        std::vector<Document> documents;
+    };
+
+    // the most recently used entry is at the front of the list
+    struct alignas(RESULT_CACHE_SHARD_ALIGNMENT) Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> entries;
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+        uint64_t hit_count = 0;
+        uint64_t miss_count = 0;
+    };
+
+    const SearchServer& server_;
+    size_t shard_capacity_;
+    std::vector<Shard> shards_;
+
+    // the key and the words of the query in the context
+    void MakeKey(QueryContext& context, const std::string_view raw_query, DocumentStatus status, int max_count,
+                 std::string& key) const;
+
+    Shard& GetShard(const std::string& key);
+};
@@ -1,39 +1,346 @@
 #include "search_server.h"
 
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+// index versions are unique among all servers, so a query prepared by another server is never taken as valid
+std::atomic<uint64_t> next_index_version{1};
+
+struct ServerSnapshotHeader {
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    uint32_t version;
+    uint32_t document_status_size;
+    uint32_t posting_format;
+    uint32_t stop_word_count;
+    uint64_t document_count;
+    uint64_t live_document_count;
+};
+
+} // namespace
+
 void SearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status,
                                 const std::vector<int>& ratings) {
 
     if (document_id < 0) {
         throw std::invalid_argument("Negative document ID"s);
     }
-    if (documents_.count(document_id)) {
+    if (document_indexes_.count(document_id)) {
         throw std::invalid_argument("Document with this ID already exists"s);
     }
-    if (!CheckSpecialCharInText(document)) {
+    thread_local std::vector<std::string_view> words;
+    if (!SplitIntoWordsNoStop(document, words)) {
         throw std::invalid_argument("Special char in document"s);
     }
 
-    const std::vector<std::string_view> words = SplitIntoWordsNoStop(document);
-    
     const double inv_word_count = words.empty() ? 0 : 1.0 / words.size();
 
+    CollectMerge(false);
+    index_version_ = GetNewIndexVersion();
+
+    std::map<TermId, int> term_counts;
     for (const std::string_view word : words) {
-        auto it = std::find(data_.begin(), data_.end(), word);
-        if (it == data_.end()) {
-            data_.push_back(static_cast<std::string>(word));
-            it = std::next(data_.end(), -1);
-        }
+        ++term_counts[dictionary_.Intern(word)];
+    }
 
-        word_to_document_freqs_[*it][document_id] += inv_word_count;
-        documents_words_[document_id][*it] += inv_word_count;
+    // term freq is count * inv_word_count, the compressed postings restore it the same way
+    const int document_index = static_cast<int>(document_attributes_.size());
+    thread_local std::vector<std::pair<TermId, double>> term_freqs;
+    term_freqs.clear();
+    term_statistics_.Resize(dictionary_.size());
+    for (const auto [term_id, term_count] : term_counts) {
+        term_freqs.push_back({term_id, term_count * inv_word_count});
+        term_statistics_.AddDocuments(term_id, 1, term_count * inv_word_count);
     }
+    forward_index_.AddDocument(term_freqs);
+    mutable_segment_.AddDocument(document_index, term_counts, static_cast<int>(words.size()));
 
-    documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status});
+    document_attributes_.Add(document_id, ComputeAverageRating(ratings), status);
+    removed_documents_.push_back(false);
+    document_indexes_.emplace(document_id, document_index);
     documents_id_.insert(document_id);
+
+    if (mutable_segment_.GetEndIndex() - mutable_segment_.GetBeginIndex() >= SEGMENT_DOCUMENT_COUNT) {
+        SealMutableSegment();
+    }
+}
+
+template <typename ExecutionPolicy>
+void SearchServer::AddDocumentBatch(ExecutionPolicy&& policy, const std::vector<NewDocument>& documents) {
+    // the whole batch is checked before the server is changed
+    std::vector<int> document_ids(documents.size());
+    std::transform(policy, documents.begin(), documents.end(), document_ids.begin(), [](const NewDocument& document) {
+        return document.id;
+    });
+    std::sort(policy, document_ids.begin(), document_ids.end());
+    if (!document_ids.empty() && document_ids.front() < 0) {
+        throw std::invalid_argument("Negative document ID"s);
+    }
+    if (std::adjacent_find(policy, document_ids.begin(), document_ids.end()) != document_ids.end()
+        || std::any_of(policy, document_ids.begin(), document_ids.end(), [this](const int document_id) {
+               return document_indexes_.count(document_id) != 0;
+           })) {
+        throw std::invalid_argument("Document with this ID already exists"s);
+    }
+
+    // the words of every document are looked up in the dictionary and counted in place by sorting their ids,
+    // the words missing in the dictionary are kept aside until the batch is checked
+    std::vector<ParsedDocument> parsed_documents(documents.size());
+    std::vector<std::vector<std::string_view>> new_words(documents.size());
+    std::atomic<bool> has_special_char = false;
+    std::for_each(policy, documents.begin(), documents.end(), [&](const NewDocument& document) {
+        const size_t i = &document - documents.data();
+        thread_local std::vector<std::string_view> words;
+        thread_local std::vector<TermId> term_ids;
+        if (!SplitIntoWordsNoStop(document.text, words)) {
+            has_special_char = true;
+            return;
+        }
+        term_ids.clear();
+        for (const std::string_view word : words) {
+            const TermId term_id = dictionary_.Find(word);
+            if (term_id == NO_TERM) {
+                new_words[i].push_back(word);
+            } else {
+                term_ids.push_back(term_id);
+            }
+        }
+        std::sort(term_ids.begin(), term_ids.end());
+        ParsedDocument& parsed_document = parsed_documents[i];
+        parsed_document.length = static_cast<int>(words.size());
+        parsed_document.term_counts.reserve(term_ids.size());
+        for (const TermId term_id : term_ids) {
+            if (!parsed_document.term_counts.empty() && parsed_document.term_counts.back().first == term_id) {
+                ++parsed_document.term_counts.back().second;
+            } else {
+                parsed_document.term_counts.push_back({term_id, 1});
+            }
+        }
+    });
+    if (has_special_char) {
+        throw std::invalid_argument("Special char in document"s);
+    }
+
+    CollectMerge(false);
+    index_version_ = GetNewIndexVersion();
+
+    // new words get their ids in the order of the documents, so the ids don't depend on the policy.
+    // Only the documents with such words are counted again, by sorting the term ids in place
+    for (size_t i = 0; i < documents.size(); ++i) {
+        if (new_words[i].empty()) {
+            continue;
+        }
+        std::vector<std::pair<TermId, int>>& term_counts = parsed_documents[i].term_counts;
+        for (const std::string_view word : new_words[i]) {
+            term_counts.push_back({dictionary_.Intern(word), 1});
+        }
+        std::sort(term_counts.begin(), term_counts.end());
+        size_t count_end = 0;
+        for (const auto& [term_id, term_count] : term_counts) {
+            if (count_end != 0 && term_counts[count_end - 1].first == term_id) {
+                term_counts[count_end - 1].second += term_count;
+            } else {
+                term_counts[count_end++] = {term_id, term_count};
+            }
+        }
+        term_counts.resize(count_end);
+    }
+
+    // statistics of a term are updated once per batch
+    std::vector<int> batch_document_freqs(dictionary_.size(), 0);
+    std::vector<double> batch_max_term_freqs(dictionary_.size(), 0.0);
+    const int begin_index = static_cast<int>(document_attributes_.size());
+    std::vector<std::pair<TermId, double>> term_freqs;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const NewDocument& document = documents[i];
+        const ParsedDocument& parsed_document = parsed_documents[i];
+        // term freq is count * inv_word_count, as in AddDocument
+        const double inv_word_count = parsed_document.length == 0 ? 0 : 1.0 / parsed_document.length;
+        term_freqs.clear();
+        for (const auto& [term_id, term_count] : parsed_document.term_counts) {
+            const double term_freq = term_count * inv_word_count;
+            term_freqs.push_back({term_id, term_freq});
+            ++batch_document_freqs[term_id];
+            batch_max_term_freqs[term_id] = std::max(batch_max_term_freqs[term_id], term_freq);
+        }
+        forward_index_.AddDocument(term_freqs);
+        document_attributes_.Add(document.id, ComputeAverageRating(document.ratings), document.status);
+        removed_documents_.push_back(false);
+        document_indexes_.emplace(document.id, begin_index + static_cast<int>(i));
+        documents_id_.insert(document.id);
+    }
+    term_statistics_.Resize(dictionary_.size());
+    for (size_t term_id = 0; term_id < batch_document_freqs.size(); ++term_id) {
+        if (batch_document_freqs[term_id] != 0) {
+            term_statistics_.AddDocuments(static_cast<TermId>(term_id), batch_document_freqs[term_id], batch_max_term_freqs[term_id]);
+        }
+    }
+
+    if (documents.size() < static_cast<size_t>(SEGMENT_DOCUMENT_COUNT)) {
+        for (size_t i = 0; i < documents.size(); ++i) {
+            mutable_segment_.AddDocument(begin_index + static_cast<int>(i), parsed_documents[i].term_counts, parsed_documents[i].length);
+            if (mutable_segment_.GetEndIndex() - mutable_segment_.GetBeginIndex() >= SEGMENT_DOCUMENT_COUNT) {
+                SealMutableSegment();
+            }
+        }
+        return;
+    }
+
+    // a large batch becomes one sealed segment, its term lists are filled in parallel
+    if (mutable_segment_.GetEndIndex() != mutable_segment_.GetBeginIndex()) {
+        SealMutableSegment();
+    }
+    sealed_segments_.push_back(MakeSealedSegment(std::make_shared<const IndexSegment>(
+        IndexSegment::Build(policy, posting_format_, begin_index, parsed_documents.begin(), parsed_documents.end()))));
+    mutable_segment_ = IndexSegment(posting_format_, static_cast<int>(document_attributes_.size()));
+    StartMerge();
+}
+
+void SearchServer::AddDocuments(const std::vector<NewDocument>& documents) {
+    AddDocuments(std::execution::seq, documents);
+}
+
+void SearchServer::AddDocuments(const std::execution::sequenced_policy& policy, const std::vector<NewDocument>& documents) {
+    AddDocumentBatch(policy, documents);
+}
+
+void SearchServer::AddDocuments(const std::execution::parallel_policy& policy, const std::vector<NewDocument>& documents) {
+    AddDocumentBatch(policy, documents);
+}
+
+size_t SearchServer::GetPostingsMemoryUsage() const {
+    size_t memory_usage = 0;
+    ForEachSegment([&memory_usage](const IndexSegment& segment) {
+        memory_usage += segment.GetMemoryUsage();
+    });
+    return memory_usage;
+}
+
+size_t SearchServer::GetPostingCount() const {
+    size_t posting_count = 0;
+    ForEachSegment([&posting_count](const IndexSegment& segment) {
+        posting_count += segment.GetPostingCount();
+    });
+    return posting_count;
+}
+
+void SearchServer::WaitForMerges() {
+    while (merge_.valid()) {
+        CollectMerge(true);
+    }
+}
+
+uint64_t SearchServer::GetNewIndexVersion() {
+    return next_index_version.fetch_add(1);
+}
+
+void SearchServer::MarkRemoved(int document_index) {
+    MarkRemoved(std::vector<int>{document_index});
+}
+
+void SearchServer::MarkRemoved(const std::vector<int>& document_indexes) {
+    index_version_ = GetNewIndexVersion();
+    auto segment_it = sealed_segments_.begin();
+    for (const int document_index : document_indexes) {
+        removed_documents_[document_index] = true;
+        document_attributes_.Remove(document_index);
+        while (segment_it != sealed_segments_.end() && segment_it->segment->GetEndIndex() <= document_index) {
+            ++segment_it;
+        }
+        if (segment_it != sealed_segments_.end()) {
+            ++segment_it->removed_count;
+        }
+    }
+    // a segment may have become mostly removed
+    StartMerge();
+}
+
+// the documents of the range missing in the segment were removed before, the rest of the removed are present
+SearchServer::SealedSegment SearchServer::MakeSealedSegment(std::shared_ptr<const IndexSegment> segment) const {
+    const int begin_index = segment->GetBeginIndex();
+    const int end_index = segment->GetEndIndex();
+    const int removed_count = static_cast<int>(std::count(removed_documents_.begin() + begin_index,
+                                                          removed_documents_.begin() + end_index, true));
+    const int dropped_count = end_index - begin_index - segment->GetDocumentCount();
+    return {std::move(segment), removed_count - dropped_count};
+}
+
+void SearchServer::SealMutableSegment() {
+    const int end_index = mutable_segment_.GetEndIndex();
+    mutable_segment_.ShrinkToFit();
+    sealed_segments_.push_back(MakeSealedSegment(std::make_shared<const IndexSegment>(std::move(mutable_segment_))));
+    mutable_segment_ = IndexSegment(posting_format_, end_index);
+    StartMerge();
+}
+
+int SearchServer::GetSegmentTier(const SealedSegment& sealed_segment) {
+    const int64_t live_count = sealed_segment.segment->GetDocumentCount() - sealed_segment.removed_count;
+    int tier = 0;
+    for (int64_t tier_size = SEGMENT_DOCUMENT_COUNT * SEGMENT_MERGE_FACTOR; live_count >= tier_size; tier_size *= SEGMENT_MERGE_FACTOR) {
+        ++tier;
+    }
+    return tier;
+}
+
+void SearchServer::StartMerge() {
+    if (merge_.valid()) {
+        return;
+    }
+
+    size_t first = sealed_segments_.size();
+    size_t count = 0;
+    for (size_t i = 0; i < sealed_segments_.size(); ++i) {
+        if (sealed_segments_[i].removed_count * 2 > sealed_segments_[i].segment->GetDocumentCount()) {
+            first = i;
+            count = 1;
+            break;
+        }
+    }
+    // the newest run of one tier, new segments are small, so it is usually the tail
+    for (size_t end = sealed_segments_.size(); count == 0 && end >= static_cast<size_t>(SEGMENT_MERGE_FACTOR); --end) {
+        const int tier = GetSegmentTier(sealed_segments_[end - 1]);
+        const size_t begin = end - SEGMENT_MERGE_FACTOR;
+        if (std::all_of(sealed_segments_.begin() + begin, sealed_segments_.begin() + end, [tier](const SealedSegment& sealed_segment) {
+                return GetSegmentTier(sealed_segment) == tier;
+            })) {
+            first = begin;
+            count = SEGMENT_MERGE_FACTOR;
+        }
+    }
+    if (count == 0) {
+        return;
+    }
+
+    // the merge reads only sealed segments and its own copy of the removed flags
+    std::vector<std::shared_ptr<const IndexSegment>> segments;
+    for (size_t i = first; i < first + count; ++i) {
+        segments.push_back(sealed_segments_[i].segment);
+    }
+    const int begin_index = segments.front()->GetBeginIndex();
+    std::vector<bool> removed(removed_documents_.begin() + begin_index, removed_documents_.begin() + segments.back()->GetEndIndex());
+    merge_first_segment_ = first;
+    merge_segment_count_ = count;
+    merge_ = std::async(std::launch::async, [segments = std::move(segments), removed = std::move(removed), begin_index] {
+        return std::make_shared<const IndexSegment>(IndexSegment::Merge(segments, [&](const int document_index) {
+            return removed[document_index - begin_index];
+        }));
+    });
+}
+
+void SearchServer::CollectMerge(bool is_waiting) {
+    if (!merge_.valid() || (!is_waiting && merge_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)) {
+        return;
+    }
+
+    const auto first = sealed_segments_.begin() + merge_first_segment_;
+    sealed_segments_.erase(first + 1, first + merge_segment_count_);
+    *first = MakeSealedSegment(merge_.get());
+    StartMerge();
 }
 
 int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+    return document_indexes_.size();
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument
@@ -41,30 +348,12 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
     if (document_id < 0) {
         throw std::out_of_range("Negative document ID"s);
     }
-    if (!documents_.count(document_id)) {
+    if (!document_indexes_.count(document_id)) {
         throw std::out_of_range("Document with this ID not found"s);
     }
 
-    const Query query = ParseQuery(raw_query);
-
-    const auto& it = documents_words_.at(document_id);
-    std::vector<std::string_view> matched_words;
-    
-    if (std::any_of(it.begin(), it.end(), [&query](const auto& element) {
-                return query.minus_words.count(element.first);})) {
-        return {matched_words, documents_.at(document_id).status};
-    }
-
-    matched_words.resize(it.size());
-
-    std::vector<std::string_view> words_in_doc(it.size());
-    std::transform(it.begin(), it.end(), words_in_doc.begin(), 
-                            [](const auto& element) {return element.first;});
-
-    matched_words.resize(std::set_intersection(words_in_doc.begin(), words_in_doc.end(), 
-        query.plus_words.begin(), query.plus_words.end(), matched_words.begin()) - matched_words.begin());
-    
-    return {matched_words, documents_.at(document_id).status};
+    const int document_index = document_indexes_.at(document_id);
+    return {MatchDocumentWords(ParseQuery(raw_query), document_index), document_attributes_.GetStatus(document_index)};
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument
@@ -77,52 +366,41 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
     if (document_id < 0) {
         throw std::out_of_range("Negative document ID"s);
     }
-    if (!documents_.count(document_id)) {
+    if (!document_indexes_.count(document_id)) {
         throw std::out_of_range("Document with this ID not found"s);
     }
 
-    const QueryVect query = ParseQuery(std::execution::par, raw_query, false);
-
-    const auto& it = documents_words_.at(document_id);
-    std::vector<std::string_view> matched_words;
-    
-    if (it.end() != std::find_first_of(std::execution::par, it.begin(), it.end(), query.minus_words.begin(), query.minus_words.end(), 
-                                       [](const auto& lhs, const std::string_view rhs) {return lhs.first == rhs;})) {
-        return {matched_words, documents_.at(document_id).status};
-    }
-
-    matched_words.resize(query.plus_words.size());
-
-    matched_words.resize(std::copy_if(std::execution::par, query.plus_words.begin(), query.plus_words.end(), 
-                                matched_words.begin(), [&] (const std::string_view word) {return it.count(word);})
-                         - matched_words.begin());
+    const int document_index = document_indexes_.at(document_id);
+    return {MatchDocumentWords(ParseQuery(std::execution::par, raw_query, false), document_index), document_attributes_.GetStatus(document_index)};
+}
 
-    std::sort(std::execution::par, matched_words.begin(), matched_words.end());
-    matched_words.erase(std::unique(std::execution::par, matched_words.begin(), matched_words.end()), matched_words.end());
-    
-    return {matched_words, documents_.at(document_id).status};
+WordFrequencies SearchServer::GetWordFrequencies(int document_id) const {
+    return {dictionary_, GetDocumentWords(document_id)};
 }
 
-const std::map<std::string_view, double> SearchServer::GetWordFrequencies (int document_id) const {
-    if (documents_words_.count(document_id)) {
-        return documents_words_.at(document_id);
+DocumentWords SearchServer::GetDocumentWords(int document_id) const {
+    const auto index_it = document_indexes_.find(document_id);
+    if (index_it == document_indexes_.end()) {
+        return {};
     }
-    static const std::map<std::string_view, double> empty = {};
-    return empty;
+    return forward_index_.GetWords(index_it->second);
 }
 
- void SearchServer::RemoveDocument(int document_id) {
-    if (!documents_.count(document_id)) {
+void SearchServer::RemoveDocument(int document_id) {
+    const auto index_it = document_indexes_.find(document_id);
+    if (index_it == document_indexes_.end()) {
         return;
     }
+    CollectMerge(false);
 
-    for (const auto& [word, _] : documents_words_.at(document_id)) {
-        word_to_document_freqs_[word].erase(document_id);
+    const DocumentWords words = forward_index_.GetWords(index_it->second);
+    for (size_t i = 0; i < words.size(); ++i) {
+        term_statistics_.RemoveDocument(words.GetTermId(i));
     }
+    MarkRemoved(index_it->second);
 
-    documents_words_.erase(document_id);
     documents_id_.erase(document_id);
-    documents_.erase(document_id);
+    document_indexes_.erase(index_it);
 }
 
 void SearchServer::RemoveDocument(const std::execution::sequenced_policy&, int document_id) {
@@ -130,40 +408,260 @@ void SearchServer::RemoveDocument(const std::execution::sequenced_policy&, int d
 }
 
 void SearchServer::RemoveDocument(const std::execution::parallel_policy&, int document_id) {
-    if (!documents_.count(document_id)) {
+    const auto index_it = document_indexes_.find(document_id);
+    if (index_it == document_indexes_.end()) {
         return;
     }
+    CollectMerge(false);
 
-    const auto& it = documents_words_.at(document_id);
+    const DocumentWords words = forward_index_.GetWords(index_it->second);
+    MarkRemoved(index_it->second);
 
-    std::vector<std::string_view> words(it.size());
+    documents_id_.erase(document_id);
+    document_indexes_.erase(index_it);
 
-    std::transform(std::execution::par, it.begin(), it.end(), words.begin(), [](const auto& element) {
-        return element.first;}); 
+    // the terms of a document are distinct, so are their counters
+    std::for_each(std::execution::par, words.GetTermIds(), words.GetTermIds() + words.size(), [&] (const TermId term_id) {
+        term_statistics_.RemoveDocument(term_id);
+    });
+}
 
-    documents_words_.erase(document_id);
-    documents_id_.erase(document_id);
-    documents_.erase(document_id); 
+template <typename ExecutionPolicy>
+void SearchServer::RemoveDocumentBatch(ExecutionPolicy&& policy, const std::vector<int>& document_ids) {
+    std::vector<int> document_indexes;
+    for (const int document_id : document_ids) {
+        const auto index_it = document_indexes_.find(document_id);
+        if (index_it == document_indexes_.end()) {
+            continue;
+        }
+        document_indexes.push_back(index_it->second);
+        documents_id_.erase(document_id);
+        document_indexes_.erase(index_it);
+    }
+    if (document_indexes.empty()) {
+        return;
+    }
+    CollectMerge(false);
+    std::sort(policy, document_indexes.begin(), document_indexes.end());
 
-    std::for_each(std::execution::par, words.begin(), words.end(), [&] (const std::string_view word) {
-        word_to_document_freqs_[word].erase(document_id);
-        return word;}); 
-  
+    // every document frequency is decreased once by the number of removed documents with the term
+    std::vector<size_t> word_offsets(document_indexes.size() + 1, 0);
+    for (size_t i = 0; i < document_indexes.size(); ++i) {
+        word_offsets[i + 1] = word_offsets[i] + forward_index_.GetWords(document_indexes[i]).size();
+    }
+    std::vector<TermId> term_ids(word_offsets.back());
+    std::vector<size_t> positions(document_indexes.size());
+    std::iota(positions.begin(), positions.end(), 0);
+    std::for_each(policy, positions.begin(), positions.end(), [&](const size_t i) {
+        const DocumentWords words = forward_index_.GetWords(document_indexes[i]);
+        std::copy(words.GetTermIds(), words.GetTermIds() + words.size(), term_ids.begin() + word_offsets[i]);
+    });
+    std::sort(policy, term_ids.begin(), term_ids.end());
+    for (auto term_begin = term_ids.begin(); term_begin != term_ids.end();) {
+        const auto term_end = std::upper_bound(term_begin, term_ids.end(), *term_begin);
+        term_statistics_.RemoveDocuments(*term_begin, static_cast<int>(term_end - term_begin));
+        term_begin = term_end;
+    }
+
+    MarkRemoved(document_indexes);
 }
 
-bool SearchServer::IsStopWord(const std::string_view word) const {
-    return stop_words_.count(word) > 0;
+void SearchServer::RemoveDocuments(const std::vector<int>& document_ids) {
+    RemoveDocumentBatch(std::execution::seq, document_ids);
+}
+
+void SearchServer::RemoveDocuments(const std::execution::sequenced_policy& policy, const std::vector<int>& document_ids) {
+    RemoveDocumentBatch(policy, document_ids);
+}
+
+void SearchServer::RemoveDocuments(const std::execution::parallel_policy& policy, const std::vector<int>& document_ids) {
+    RemoveDocumentBatch(policy, document_ids);
+}
+
+void SearchServer::Compact() {
+    WaitForMerges();
+
+    // the terms keep their order, so the words of a document stay sorted by term id
+    std::vector<TermId> new_term_ids(dictionary_.size(), NO_TERM);
+    TermDictionary dictionary;
+    for (size_t term_id = 0; term_id < dictionary_.size(); ++term_id) {
+        if (term_statistics_.GetDocumentFreq(term_id) > 0) {
+            new_term_ids[term_id] = dictionary.Intern(dictionary_.GetTerm(term_id));
+        }
+    }
+    TermStatistics term_statistics;
+    term_statistics.Resize(dictionary.size());
+    for (size_t term_id = 0; term_id < dictionary_.size(); ++term_id) {
+        if (new_term_ids[term_id] != NO_TERM) {
+            term_statistics.AddDocuments(new_term_ids[term_id], term_statistics_.GetDocumentFreq(term_id),
+                                         term_statistics_.GetMaxTermFreq(term_id));
+        }
+    }
+
+    const auto is_removed = [this](const int document_index) {
+        return removed_documents_[document_index];
+    };
+    for (SealedSegment& sealed_segment : sealed_segments_) {
+        sealed_segment = MakeSealedSegment(std::make_shared<const IndexSegment>(sealed_segment.segment->Compact(is_removed, new_term_ids)));
+    }
+    mutable_segment_ = mutable_segment_.Compact(is_removed, new_term_ids);
+
+    ForwardIndex forward_index;
+    std::vector<std::pair<TermId, double>> term_freqs;
+    for (size_t document_index = 0; document_index < forward_index_.GetDocumentCount(); ++document_index) {
+        term_freqs.clear();
+        if (!removed_documents_[document_index]) {
+            const DocumentWords words = forward_index_.GetWords(static_cast<int>(document_index));
+            for (size_t i = 0; i < words.size(); ++i) {
+                term_freqs.push_back({new_term_ids[words.GetTermId(i)], words.GetTermFreq(i)});
+            }
+        }
+        forward_index.AddDocument(term_freqs);
+    }
+
+    dictionary_ = std::move(dictionary);
+    term_statistics_ = std::move(term_statistics);
+    forward_index_ = std::move(forward_index);
+    index_version_ = GetNewIndexVersion();
+    StartMerge();
 }
 
+void SearchServer::SaveSnapshot(const std::string& path) const {
+    std::vector<uint64_t> stop_word_offsets = { 0 };
+    std::string stop_word_chars;
+    for (const std::string& word : stop_words_) {
+        stop_word_chars += word;
+        stop_word_offsets.push_back(stop_word_chars.size());
+    }
+
+    std::vector<int> live_ids;
+    std::vector<int> live_indexes;
+    for (const auto& [document_id, document_index] : document_indexes_) {
+        live_ids.push_back(document_id);
+        live_indexes.push_back(document_index);
+    }
+
+    ServerSnapshotHeader header = {};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.document_status_size = sizeof(DocumentStatus);
+    header.posting_format = static_cast<uint32_t>(posting_format_);
+    header.stop_word_count = static_cast<uint32_t>(stop_words_.size());
+    header.document_count = document_attributes_.size();
+    header.live_document_count = live_ids.size();
+
+    SnapshotWriter writer(path);
+    writer.WriteValue(header);
+    writer.WriteArray(stop_word_offsets.data(), stop_word_offsets.size());
+    writer.WriteArray(stop_word_chars.data(), stop_word_chars.size());
+    dictionary_.Save(writer);
+    writer.WriteArray(term_statistics_.GetDocumentFreqs().data(), term_statistics_.size());
+    // the mutable segment is saved as a sealed one
+    writer.WriteValue(static_cast<uint64_t>(GetSegmentCount()));
+    ForEachSegment([&writer](const IndexSegment& segment) {
+        segment.Save(writer);
+    });
+    document_attributes_.Save(writer);
+    writer.WriteArray(live_ids.data(), live_ids.size());
+    writer.WriteArray(live_indexes.data(), live_indexes.size());
+    // words of removed documents are left out
+    forward_index_.Save(writer, [this](const size_t document_index) {
+        return removed_documents_[document_index];
+    });
+    writer.Finish();
+}
+
+SearchServer SearchServer::LoadSnapshot(const std::string& path) {
+    auto file = std::make_shared<const MappedFile>(path);
+    SnapshotReader reader(file->data(), file->size());
+
+    const ServerSnapshotHeader& header = reader.ReadValue<ServerSnapshotHeader>();
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || header.version != SNAPSHOT_VERSION
+        || header.document_status_size != sizeof(DocumentStatus) || header.posting_format > static_cast<uint32_t>(PostingFormat::COMPRESSED)) {
+        throw std::invalid_argument("Incompatible snapshot "s + path);
+    }
+
+    const uint64_t* stop_word_offsets = reader.ReadArray<uint64_t>(header.stop_word_count + 1);
+    const char* stop_word_chars = reader.ReadArray<char>(stop_word_offsets[header.stop_word_count]);
+    std::vector<std::string_view> stop_words;
+    for (uint32_t i = 0; i < header.stop_word_count; ++i) {
+        stop_words.push_back({stop_word_chars + stop_word_offsets[i], stop_word_offsets[i + 1] - stop_word_offsets[i]});
+    }
+
+    const PostingFormat posting_format = static_cast<PostingFormat>(header.posting_format);
+    SearchServer server(stop_words, posting_format);
+    server.dictionary_ = TermDictionary::Map(reader);
+    const int* document_freqs = reader.ReadArray<int>(server.dictionary_.size());
+
+    const uint64_t segment_count = reader.ReadValue<uint64_t>();
+    std::vector<std::shared_ptr<const IndexSegment>> segments;
+    for (uint64_t i = 0; i < segment_count; ++i) {
+        segments.push_back(std::make_shared<const IndexSegment>(IndexSegment::Map(posting_format, server.dictionary_.size(), reader)));
+        if (segments.back()->GetBeginIndex() != (i == 0 ? 0 : segments[i - 1]->GetEndIndex())) {
+            throw std::invalid_argument("Snapshot is truncated or corrupted"s);
+        }
+    }
 
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view text) const {
-    std::vector<std::string_view> words;
-    for (const std::string_view word : SplitIntoWords(text)) {
-        if (!IsStopWord(word)) {
-            words.push_back(word);
+    server.document_attributes_ = DocumentAttributes::Load(reader, header.document_count);
+    if (!segments.empty() && static_cast<uint64_t>(segments.back()->GetEndIndex()) != header.document_count) {
+        throw std::invalid_argument("Snapshot is truncated or corrupted"s);
+    }
+
+    // ids are sorted, every insertion goes right to the end of the trees
+    const int* live_ids = reader.ReadArray<int>(header.live_document_count);
+    const int* live_indexes = reader.ReadArray<int>(header.live_document_count);
+    for (uint64_t i = 0; i < header.live_document_count; ++i) {
+        if (live_indexes[i] < 0 || static_cast<uint64_t>(live_indexes[i]) >= header.document_count) {
+            throw std::invalid_argument("Snapshot is truncated or corrupted"s);
         }
+        server.document_indexes_.emplace_hint(server.document_indexes_.end(), live_ids[i], live_indexes[i]);
+        server.documents_id_.emplace_hint(server.documents_id_.end(), live_ids[i]);
+    }
+    server.removed_documents_.assign(header.document_count, true);
+    for (uint64_t i = 0; i < header.live_document_count; ++i) {
+        server.removed_documents_[live_indexes[i]] = false;
     }
-    return words;
+    for (uint64_t document_index = 0; document_index < header.document_count; ++document_index) {
+        if (server.removed_documents_[document_index]) {
+            server.document_attributes_.Remove(static_cast<int>(document_index));
+        }
+    }
+
+    for (auto& segment : segments) {
+        if (segment->GetBeginIndex() != segment->GetEndIndex()) {
+            server.sealed_segments_.push_back(server.MakeSealedSegment(segment));
+        }
+    }
+    server.mutable_segment_ = IndexSegment(posting_format, static_cast<int>(header.document_count));
+
+    // the largest term freqs are taken from the postings, removed documents included, as for a live server
+    std::vector<double> max_term_freqs(server.dictionary_.size(), 0.0);
+    server.ForEachSegment([&max_term_freqs](const IndexSegment& segment) {
+        segment.ForEachTerm([&max_term_freqs](const TermId term_id, const PostingList& postings) {
+            max_term_freqs[term_id] = std::max(max_term_freqs[term_id], postings.GetMaxTermFreq());
+        });
+    });
+    server.term_statistics_.Resize(server.dictionary_.size());
+    for (TermId term_id = 0; static_cast<size_t>(term_id) < server.dictionary_.size(); ++term_id) {
+        server.term_statistics_.AddDocuments(term_id, document_freqs[term_id], max_term_freqs[term_id]);
+    }
+
+    server.forward_index_ = ForwardIndex::Map(reader, header.document_count);
+    server.snapshot_ = std::move(file);
+    return server;
+}
+
+bool SearchServer::IsStopWord(const std::string_view word) const {
+    return stop_words_.count(word) > 0;
+}
+
+
+bool SearchServer::SplitIntoWordsNoStop(const std::string_view text, std::vector<std::string_view>& words) const {
+    const bool is_valid = SplitIntoWords(text, words);
+    words.erase(std::remove_if(words.begin(), words.end(), [this](const std::string_view word) {
+        return IsStopWord(word);
+    }), words.end());
+    return is_valid;
 }
 
 int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
@@ -189,16 +687,17 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) cons
     if (text.empty()) {
         throw std::invalid_argument("empty word in request"s);
     }
-
-    if (!CheckSpecialCharInText(text)) {
-        throw std::invalid_argument("Special char in search query"s);
-    }
     return {text, is_minus, IsStopWord(text)};
 }
 
 SearchServer::Query SearchServer::ParseQuery(const std::string_view text) const {
     Query query;
-    for (const std::string_view word : SplitIntoWords(text)) {
+    // the words are checked for special chars by the tokenizer
+    thread_local std::vector<std::string_view> words;
+    if (!SplitIntoWords(text, words)) {
+        throw std::invalid_argument("Special char in search query"s);
+    }
+    for (const std::string_view word : words) {
         const QueryWord query_word = ParseQueryWord(word);
         if (!query_word.is_stop) {
             if (query_word.is_minus) {
@@ -211,9 +710,93 @@ SearchServer::Query SearchServer::ParseQuery(const std::string_view text) const
     return query;
 }
 
+void SearchServer::ParseQueryWords(QueryContext& context, const std::string_view text) const {
+    if (!SplitIntoWords(text, context.words_)) {
+        throw std::invalid_argument("Special char in search query"s);
+    }
+    QueryContext::QueryWords& query_words = context.query_words_;
+    query_words.plus_words.clear();
+    query_words.minus_words.clear();
+    for (const std::string_view word : context.words_) {
+        const QueryWord query_word = ParseQueryWord(word);
+        if (!query_word.is_stop) {
+            (query_word.is_minus ? query_words.minus_words : query_words.plus_words).push_back(query_word.data);
+        }
+    }
+    // the order of the std::set of ParseQuery, so the relevance is summed the same way
+    for (std::vector<std::string_view>* words : { &query_words.plus_words, &query_words.minus_words }) {
+        std::sort(words->begin(), words->end());
+        words->erase(std::unique(words->begin(), words->end()), words->end());
+    }
+}
+
+void SearchServer::ParseQuery(QueryContext& context, const std::string_view text) const {
+    SEARCH_PROBE(Probe::PARSE);
+    ParseQueryWords(context, text);
+    ResolveQuery(context.query_words_, context.query_);
+}
+
+void SearchServer::NormalizeQuery(QueryContext& context, const std::string_view raw_query, std::string& normalized_query) const {
+    ParseQueryWords(context, raw_query);
+    for (const std::string_view word : context.query_words_.plus_words) {
+        normalized_query += ' ';
+        normalized_query += word;
+    }
+    for (const std::string_view word : context.query_words_.minus_words) {
+        normalized_query += " -"s;
+        normalized_query += word;
+    }
+}
+
+PreparedQuery SearchServer::Prepare(const std::string_view raw_query) const {
+    QueryContext context;
+    ParseQuery(context, raw_query);
+    PreparedQuery query;
+    const QueryContext::QueryWords& query_words = context.query_words_;
+    query.words_.plus_words.assign(query_words.plus_words.begin(), query_words.plus_words.end());
+    query.words_.minus_words.assign(query_words.minus_words.begin(), query_words.minus_words.end());
+    query.query_ = std::move(context.query_);
+    query.index_version_ = index_version_;
+    return query;
+}
+
+void SearchServer::AccumulateRelevance(const ResolvedQuery& query, const IndexSegment& segment, int begin_index, int end_index,
+                                       const uint64_t* status_bitmap, RelevanceAccumulator& accumulator) const {
+    {
+        SEARCH_PROBE(Probe::MINUS_WORDS);
+        for (const TermId term_id : query.minus_terms) {
+            segment.GetPostings(term_id).ForEach(begin_index, end_index, [&](const int document_index, double) {
+                accumulator.Exclude(document_index);
+            });
+        }
+        // the documents of other statuses are excluded up front, so the scan below has no check per posting
+        if (status_bitmap != nullptr) {
+            for (int document_index = begin_index; document_index < end_index; ++document_index) {
+                if (!DocumentAttributes::TestBit(status_bitmap, document_index)) {
+                    accumulator.Exclude(document_index);
+                }
+            }
+        }
+    }
+
+    // a posting is read and added in one step, so the scan and the adds are timed together
+    SEARCH_PROBE(Probe::POSTING_SCAN);
+    for (const auto& [term_id, inverse_document_freq] : query.plus_terms) {
+        const PostingList& postings = segment.GetPostings(term_id);
+        postings.ForEach(begin_index, end_index, [&](const int document_index, const double term_freq) {
+            accumulator.Add(document_index, term_freq * inverse_document_freq);
+        });
+    }
+}
+
 SearchServer::QueryVect SearchServer::ParseQuery(const std::execution::parallel_policy &, const std::string_view text, const bool is_sort = false) const {
     QueryVect query;
-    for (const std::string_view word : SplitIntoWords(text)) {
+    // the words are checked for special chars by the tokenizer
+    thread_local std::vector<std::string_view> words;
+    if (!SplitIntoWords(text, words)) {
+        throw std::invalid_argument("Special char in search query"s);
+    }
+    for (const std::string_view word : words) {
         const QueryWord query_word = ParseQueryWord(word);
         if (!query_word.is_stop) {
             if (query_word.is_minus) {
@@ -227,14 +810,46 @@ SearchServer::QueryVect SearchServer::ParseQuery(const std::execution::parallel_
         std::sort(std::execution::par, query.plus_words.begin(), query.plus_words.end());
         query.plus_words.erase(std::unique(std::execution::par, query.plus_words.begin(), query.plus_words.end()), query.plus_words.end());
         
-        std::sort(std::execution::par, query.plus_words.begin(), query.plus_words.end());
+        std::sort(std::execution::par, query.minus_words.begin(), query.minus_words.end());
         query.minus_words.erase(std::unique(std::execution::par, query.minus_words.begin(), query.minus_words.end()), query.minus_words.end());
     }
     return query;
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const std::string_view word) const {
-    return std::log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+double SearchServer::ComputeWordInverseDocumentFreq(TermId term_id) const {
+    return term_statistics_.GetInverseDocumentFreq(term_id, GetDocumentCount());
+}
+
+std::vector<Document> SearchServer::SelectTopDocuments(const std::execution::sequenced_policy &, 
+                                                       const std::vector<Document>& documents, int max_count) {
+    SEARCH_PROBE(Probe::TOP_K);
+    TopDocuments top(std::max(max_count, 0));
+    for (const Document& document : documents) {
+        top.Push(document);
+    }
+    return top.Extract();
+}
+
+std::vector<Document> SearchServer::SelectTopDocuments(const std::execution::parallel_policy &, 
+                                                       const std::vector<Document>& documents, int max_count) {
+    SEARCH_PROBE(Probe::TOP_K);
+    const size_t chunk_count = std::max(1u, std::thread::hardware_concurrency());
+    const size_t chunk_size = (documents.size() + chunk_count - 1) / chunk_count;
+
+    std::vector<TopDocuments> chunk_tops(chunk_count, TopDocuments(std::max(max_count, 0)));
+    std::for_each(std::execution::par, chunk_tops.begin(), chunk_tops.end(), [&](TopDocuments& top) {
+        const size_t begin = std::min(documents.size(), (&top - chunk_tops.data()) * chunk_size);
+        const size_t end = std::min(documents.size(), begin + chunk_size);
+        for (size_t i = begin; i < end; ++i) {
+            top.Push(documents[i]);
+        }
+    });
+
+    TopDocuments top(std::max(max_count, 0));
+    for (const TopDocuments& chunk_top : chunk_tops) {
+        top.Merge(chunk_top);
+    }
+    return top.Extract();
 }
 
 bool SearchServer::CheckSpecialCharInText(const std::string_view text) const{
@@ -12,59 +12,198 @@
 #include <string_view>
 #include <list>
 #include <future>
+#include <thread>
 #include <type_traits>
 #include <cassert>
+#include <limits>
+#include <numeric>
+#include <cstdint>
+#include <memory>
+#include <atomic>
 
 #include "string_processing.h"
 #include "document.h"
-#include "log_duration.h"
-#include "concurrent_map.h"
+#include "instrumentation.h"
+#include "term_dictionary.h"
+#include "posting_list.h"
+#include "top_documents.h"
+#include "relevance_accumulator.h"
+#include "snapshot.h"
+#include "index_segment.h"
+#include "term_statistics.h"
+#include "forward_index.h"
+#include "document_attributes.h"
+#include "query_executor.h"
+#include "stop_token.h"
+#include "query_context.h"
+#include "prepared_query.h"
 
 using namespace std::string_literals;
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
-const double INNACURATE = 1e-6;
-const int CONCURRENT_MAP_BUCKETS_COUNT = 500;
+const int PRUNING_WINDOW_SIZE = 4096;
+// a search that may be stopped checks its stop token before every so many document indexes
+const int STOP_CHECK_INTERVAL = 4096;
 
 class SearchServer
 {
 public:
 
-    explicit SearchServer(const std::string& stop_words_text)
-        : SearchServer(SplitIntoWords(stop_words_text)) {}
+    explicit SearchServer(const std::string& stop_words_text, PostingFormat posting_format = PostingFormat::RAW)
+        : SearchServer(SplitIntoWords(stop_words_text), posting_format) {}
 
-    explicit SearchServer(const std::string_view stop_words_text)
-        : SearchServer(SplitIntoWords(stop_words_text)) {}
+    explicit SearchServer(const std::string_view stop_words_text, PostingFormat posting_format = PostingFormat::RAW)
+        : SearchServer(SplitIntoWords(stop_words_text), posting_format) {}
 
     template <typename StringContainer>
-    explicit SearchServer(const StringContainer& stop_words);
+    explicit SearchServer(const StringContainer& stop_words, PostingFormat posting_format = PostingFormat::RAW);
 
     void AddDocument(int document_id, const std::string_view document, DocumentStatus status,
                      const std::vector<int> &ratings);
 
+    // adds all documents or none of them. A batch of at least SEGMENT_DOCUMENT_COUNT documents
+    // goes to a new sealed segment, with the parallel policy its term lists are filled in parallel
+    void AddDocuments(const std::vector<NewDocument>& documents);
+
+    void AddDocuments(const std::execution::sequenced_policy &, const std::vector<NewDocument>& documents);
+
+    void AddDocuments(const std::execution::parallel_policy &, const std::vector<NewDocument>& documents);
+
     template <typename ExecutionPolicy, typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view raw_query, 
-                                                                DocumentPredicate document_predicate) const;
+                                           DocumentPredicate document_predicate, int max_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate) const {
-        return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate,
+                                           int max_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        return FindTopDocuments(std::execution::seq, raw_query, document_predicate, max_count);
+    }
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsPruned(const std::string_view raw_query, DocumentPredicate document_predicate,
+                                                 int max_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        return SelectTopDocumentsPruned(ParseResolvedQuery(raw_query), document_predicate, max_count);
+    }
+
+    std::vector<Document> FindTopDocumentsPruned(const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+                                                 int max_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        return FindTopDocumentsPruned(raw_query, StatusPredicate{status}, max_count);
     }
 
     template <typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view raw_query,
-                                           DocumentStatus status = DocumentStatus::ACTUAL) const {
-        return FindTopDocuments(policy, raw_query, [status](int document_id, DocumentStatus document_status, int rating)
-                                { return document_status == status; });
+                                           DocumentStatus status = DocumentStatus::ACTUAL,
+                                           int max_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        return FindTopDocuments(policy, raw_query, StatusPredicate{status}, max_count);
     }
 
     std::vector<Document> FindTopDocuments(const std::string_view raw_query,
-                                           DocumentStatus status = DocumentStatus::ACTUAL) const {
-        return FindTopDocuments(std::execution::seq, raw_query, status);
+                                           DocumentStatus status = DocumentStatus::ACTUAL,
+                                           int max_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        return FindTopDocuments(std::execution::seq, raw_query, status, max_count);
+    }
+
+    // the same result as FindTopDocuments(raw_query, ...), slices of the document indexes
+    // are scored as tasks of the executor and the calling thread takes part
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(QueryExecutor& executor, const std::string_view raw_query,
+                                           DocumentPredicate document_predicate, int max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    std::vector<Document> FindTopDocuments(QueryExecutor& executor, const std::string_view raw_query,
+                                           DocumentStatus status = DocumentStatus::ACTUAL,
+                                           int max_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        return FindTopDocuments(executor, raw_query, StatusPredicate{status}, max_count);
+    }
+
+    // the same result as FindTopDocuments(raw_query, ...), kept in the context. With the buffers of the context
+    // grown by previous queries the search makes no allocations, the reference is valid until the next search
+    template <typename DocumentPredicate>
+    const std::vector<Document>& FindTopDocuments(QueryContext& context, const std::string_view raw_query,
+                                                  DocumentPredicate document_predicate, int max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    const std::vector<Document>& FindTopDocuments(QueryContext& context, const std::string_view raw_query,
+                                                  DocumentStatus status = DocumentStatus::ACTUAL,
+                                                  int max_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        return FindTopDocuments(context, raw_query, StatusPredicate{status}, max_count);
+    }
+
+    // the search runs as a task of the executor, the server must outlive the result and must not be changed
+    // before it. A search stopped by the token or its deadline, even before it starts, returns the top
+    // of the documents scanned until then with is_truncated set, their relevance is exact
+    template <typename DocumentPredicate>
+    std::future<SearchResult> FindTopDocumentsAsync(QueryExecutor& executor, const std::string_view raw_query, const StopToken& stop_token,
+                                                    DocumentPredicate document_predicate, int max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    std::future<SearchResult> FindTopDocumentsAsync(QueryExecutor& executor, const std::string_view raw_query, const StopToken& stop_token,
+                                                    DocumentStatus status = DocumentStatus::ACTUAL,
+                                                    int max_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        return FindTopDocumentsAsync(executor, raw_query, stop_token, StatusPredicate{status}, max_count);
+    }
+
+    // on the default executor of ProcessQueries
+    std::future<SearchResult> FindTopDocumentsAsync(const std::string_view raw_query, StopToken::Clock::time_point deadline,
+                                                    DocumentStatus status = DocumentStatus::ACTUAL,
+                                                    int max_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        return FindTopDocumentsAsync(GetDefaultQueryExecutor(), raw_query, StopToken(deadline), status, max_count);
+    }
+
+    // parses the query and resolves its words for repeated searches
+    PreparedQuery Prepare(const std::string_view raw_query) const;
+
+    // appends the sorted unique plus words and then the minus words with '-' of the query, without stop words,
+    // so queries with the same result give the same text. The words aren't looked up in the index
+    void NormalizeQuery(QueryContext& context, const std::string_view raw_query, std::string& normalized_query) const;
+
+    // the same result as FindTopDocuments(raw_query, ...) without parsing the query.
+    // An outdated query (see GetIndexVersion) is resolved again and updated
+    template <typename DocumentPredicate>
+    const std::vector<Document>& FindTopDocuments(QueryContext& context, PreparedQuery& query,
+                                                  DocumentPredicate document_predicate, int max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    const std::vector<Document>& FindTopDocuments(QueryContext& context, PreparedQuery& query,
+                                                  DocumentStatus status = DocumentStatus::ACTUAL,
+                                                  int max_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        return FindTopDocuments(context, query, StatusPredicate{status}, max_count);
+    }
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(PreparedQuery& query, DocumentPredicate document_predicate,
+                                           int max_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        QueryContext context;
+        return FindTopDocuments(context, query, document_predicate, max_count);
+    }
+
+    std::vector<Document> FindTopDocuments(PreparedQuery& query, DocumentStatus status = DocumentStatus::ACTUAL,
+                                           int max_count = MAX_RESULT_DOCUMENT_COUNT) const {
+        QueryContext context;
+        return FindTopDocuments(context, query, status, max_count);
+    }
+
+    // changes with every added or removed document, it is unique among all servers
+    uint64_t GetIndexVersion() const {
+        return index_version_;
     }
 
     int GetDocumentCount() const;
 
+    size_t GetPostingCount() const;
+
+    size_t GetPostingsMemoryUsage() const;
+
+    // words of the documents added after the last snapshot load, the mapped ones are not counted
+    size_t GetForwardIndexMemoryUsage() const {
+        return forward_index_.GetMemoryUsage();
+    }
+
+    // sealed segments and the mutable one
+    size_t GetSegmentCount() const {
+        return sealed_segments_.size() + 1;
+    }
+
+    // waits for the background merges and installs their results, a finished merge
+    // is otherwise installed by the next AddDocument or RemoveDocument
+    void WaitForMerges();
+
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument
         (const std::string_view raw_query, int document_id) const;
 
@@ -84,7 +223,11 @@ public:
         return documents_id_.end();
     }
 
-    const std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
+    // empty for an unknown document, see WordFrequencies
+    WordFrequencies GetWordFrequencies(int document_id) const;
+
+    // term ids of the document in ascending order with their term freqs, empty for an unknown document
+    DocumentWords GetDocumentWords(int document_id) const;
 
     void RemoveDocument(int document_id);
 
@@ -92,22 +235,109 @@ public:
 
     void RemoveDocument(const std::execution::parallel_policy &, int document_id);
 
+    // the documents are marked removed at once and are no longer found, their postings are dropped
+    // by the background merges or by Compact(). Unknown ids are skipped
+    void RemoveDocuments(const std::vector<int>& document_ids);
+
+    void RemoveDocuments(const std::execution::sequenced_policy&, const std::vector<int>& document_ids);
+
+    void RemoveDocuments(const std::execution::parallel_policy&, const std::vector<int>& document_ids);
+
+    // drops the postings and the words of the removed documents and the terms no document has anymore,
+    // the rest of the terms get new ids. Views and words returned before are invalidated
+    void Compact();
+
+    // stop words, dictionary, postings, documents and their words, removed documents are left out
+    void SaveSnapshot(const std::string& path) const;
+
+    // the dictionary, the postings and the words of the documents are read right from the mapped file,
+    // the server keeps it mapped while it is alive
+    static SearchServer LoadSnapshot(const std::string& path);
+
 private:
-    struct DocumentData
-    {
-        int rating;
+    // the predicate of the DocumentStatus overloads: the documents of the status are found through
+    // its bitmap, so the scan skips the rest and no predicate is called per document
+    struct StatusPredicate {
         DocumentStatus status;
     };
+
     const std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, DocumentData> documents_;
+    const PostingFormat posting_format_;
+    TermDictionary dictionary_;
+    // document frequencies, IDF and the largest term freqs per term id, of live documents only
+    TermStatistics term_statistics_;
+    // by internal document index. Postings of a removed document stay in its segment
+    // until a merge drops them, queries skip them by this flag or by the status bitmaps
+    DocumentAttributes document_attributes_;
+    std::vector<bool> removed_documents_;
+    std::map<int, int> document_indexes_;
     std::set<int> documents_id_;
-    std::map<int, std::map<std::string_view, double>> documents_words_;
-    std::list<std::string> data_;
+    // words by internal document index, the ones of removed documents stay there
+    ForwardIndex forward_index_;
+    std::shared_ptr<const MappedFile> snapshot_;
+    uint64_t index_version_ = GetNewIndexVersion();
+
+    // segments cover adjacent ranges of document indexes, the mutable one is the last
+    struct SealedSegment {
+        std::shared_ptr<const IndexSegment> segment;
+        // removed documents still present in the segment
+        int removed_count;
+    };
+    std::vector<SealedSegment> sealed_segments_;
+    IndexSegment mutable_segment_;
+    // replaces merge_segment_count_ sealed segments starting from merge_first_segment_.
+    // Declared last, so it is waited for before the segments it reads are destroyed
+    size_t merge_first_segment_ = 0;
+    size_t merge_segment_count_ = 0;
+    std::future<std::shared_ptr<const IndexSegment>> merge_;
+
+    template <typename Func>
+    void ForEachSegment(Func func) const {
+        for (const SealedSegment& sealed_segment : sealed_segments_) {
+            func(*sealed_segment.segment);
+        }
+        func(mutable_segment_);
+    }
+
+    // words of a document of a batch: (term id, count) sorted by term id
+    struct ParsedDocument {
+        std::vector<std::pair<TermId, int>> term_counts;
+        int length = 0;
+    };
+
+    template <typename ExecutionPolicy>
+    void AddDocumentBatch(ExecutionPolicy&& policy, const std::vector<NewDocument>& documents);
+
+    template <typename ExecutionPolicy>
+    void RemoveDocumentBatch(ExecutionPolicy&& policy, const std::vector<int>& document_ids);
+
+    static uint64_t GetNewIndexVersion();
+
+    void MarkRemoved(int document_index);
+
+    // document_indexes are sorted
+    void MarkRemoved(const std::vector<int>& document_indexes);
+
+    SealedSegment MakeSealedSegment(std::shared_ptr<const IndexSegment> segment) const;
+
+    void SealMutableSegment();
+
+    // tiered policy: SEGMENT_MERGE_FACTOR adjacent segments of one tier, or a segment that is mostly removed
+    void StartMerge();
+
+    void CollectMerge(bool is_waiting);
+
+    static int GetSegmentTier(const SealedSegment& sealed_segment);
+
+    // the plus words of the query the document has, sorted, or none if it has a minus word.
+    // Both are found by merging the sorted term ids of the query with the ones of the document
+    template <typename QueryType>
+    std::vector<std::string_view> MatchDocumentWords(const QueryType& query, int document_index) const;
 
     bool IsStopWord(const std::string_view word) const;
 
-    std::vector<std::string_view> SplitIntoWordsNoStop(const std::string_view text) const;
+    // false if the text has special chars, like SplitIntoWords
+    bool SplitIntoWordsNoStop(const std::string_view text, std::vector<std::string_view>& words) const;
 
     static int ComputeAverageRating(const std::vector<int> &ratings);
 
@@ -135,24 +365,116 @@ private:
 
     QueryVect ParseQuery(const std::execution::parallel_policy &, const std::string_view text, const bool is_sort) const;
 
-    double ComputeWordInverseDocumentFreq(const std::string_view word) const;
+    double ComputeWordInverseDocumentFreq(TermId term_id) const;
+
+    // sorted unique words of the query in the buffers of the context
+    void ParseQueryWords(QueryContext& context, const std::string_view text) const;
+
+    // ParseQueryWords, then the resolved terms of the words
+    void ParseQuery(QueryContext& context, const std::string_view text) const;
+
+    // plus terms keep the order of the query words, so every caller sums relevance in the same order
+    template <typename QueryType>
+    ResolvedQuery ResolveQuery(const QueryType& query) const {
+        ResolvedQuery resolved;
+        ResolveQuery(query, resolved);
+        return resolved;
+    }
+
+    template <typename QueryType>
+    void ResolveQuery(const QueryType& query, ResolvedQuery& resolved) const;
+
+    // ParseQuery(args...) resolved, timed as one PARSE probe
+    template <typename... ParseArgs>
+    ResolvedQuery ParseResolvedQuery(const ParseArgs&... args) const {
+        SEARCH_PROBE(Probe::PARSE);
+        return ResolveQuery(ParseQuery(args...));
+    }
+
+    // sums relevance of the documents of [begin_index, end_index) of the segment, the accumulator must cover the range.
+    // With a status bitmap only the documents in it are matched
+    void AccumulateRelevance(const ResolvedQuery& query, const IndexSegment& segment, int begin_index, int end_index,
+                             const uint64_t* status_bitmap, RelevanceAccumulator& accumulator) const;
+
+    // the bitmap the scan is filtered with, nullptr for a predicate called per document
+    template <typename DocumentPredicate>
+    const uint64_t* GetStatusBitmap(const DocumentPredicate& document_predicate) const {
+        if constexpr (std::is_same_v<DocumentPredicate, StatusPredicate>) {
+            return document_attributes_.GetStatusBitmap(document_predicate.status);
+        } else {
+            return nullptr;
+        }
+    }
+
+    // a live document the predicate accepts
+    template <typename DocumentPredicate>
+    bool IsAccepted(const DocumentPredicate& document_predicate, int document_index) const {
+        if constexpr (std::is_same_v<DocumentPredicate, StatusPredicate>) {
+            return DocumentAttributes::TestBit(document_attributes_.GetStatusBitmap(document_predicate.status), document_index);
+        } else {
+            return !removed_documents_[document_index]
+                   && document_predicate(document_attributes_.GetId(document_index), document_attributes_.GetStatus(document_index),
+                                         document_attributes_.GetRating(document_index));
+        }
+    }
+
+    Document MakeDocument(int document_index, double relevance) const {
+        return {document_attributes_.GetId(document_index), relevance, document_attributes_.GetRating(document_index)};
+    }
+
+    // the top of the query into context.documents_, the buffers of the context are reused
+    template <typename DocumentPredicate>
+    const std::vector<Document>& SelectTopDocuments(QueryContext& context, const ResolvedQuery& query,
+                                                    DocumentPredicate document_predicate, int max_count) const;
+
+    // like SelectTopDocuments, documents are scored in ranges of STOP_CHECK_INTERVAL indexes
+    // and the token is checked before each of them
+    template <typename DocumentPredicate>
+    SearchResult SelectTopDocuments(QueryContext& context, const ResolvedQuery& query, DocumentPredicate document_predicate,
+                                    int max_count, const StopToken& stop_token) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> ScoreDocuments(const ResolvedQuery& query, DocumentPredicate document_predicate,
+                                         const IndexSegment& segment, int begin_index, int end_index) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> SelectTopDocumentsPruned(const ResolvedQuery& query, DocumentPredicate document_predicate,
+                                                   int max_count) const;
+
+    template <typename DocumentPredicate>
+    void SelectTopDocumentsPruned(const ResolvedQuery& query, DocumentPredicate document_predicate,
+                                  const IndexSegment& segment, TopDocuments& top) const;
 
     template <typename DocumentPredicate>
     std::vector<Document> FindAllDocuments(const std::execution::parallel_policy &, const std::string_view raw_query, 
                                                                                     DocumentPredicate document_predicate) const;
 
+    // every slice of the document indexes is scored by its own accumulator, for_each_slice(slice_count, func)
+    // calls func(slice) for every slice in parallel
+    template <typename DocumentPredicate, typename ForEachSlice>
+    std::vector<Document> FindAllDocuments(const ResolvedQuery& query, DocumentPredicate document_predicate,
+                                           int64_t max_slice_count, ForEachSlice for_each_slice) const;
+
     template <typename DocumentPredicate>
     std::vector<Document> FindAllDocuments(const std::execution::sequenced_policy &, const std::string_view raw_query,
                                                                                      DocumentPredicate document_predicate) const;
 
+    static std::vector<Document> SelectTopDocuments(const std::execution::sequenced_policy &, 
+                                                    const std::vector<Document>& documents, int max_count);
+
+    static std::vector<Document> SelectTopDocuments(const std::execution::parallel_policy &, 
+                                                    const std::vector<Document>& documents, int max_count);
+
     bool CheckSpecialCharInText(const std::string_view text) const;
 
     bool CheckCorrectMinusWord(const std::string_view text) const;
 };
 
 template <typename StringContainer>
-SearchServer::SearchServer(const StringContainer& stop_words)
-    : stop_words_(MakeUniqueNonEmptyStrings(stop_words)) {
+SearchServer::SearchServer(const StringContainer& stop_words, PostingFormat posting_format)
+    : stop_words_(MakeUniqueNonEmptyStrings(stop_words))
+    , posting_format_(posting_format)
+    , mutable_segment_(posting_format, 0) {
         
     for (const std::string_view word : stop_words_) {
         if (!CheckSpecialCharInText(word)) {
@@ -161,111 +483,417 @@ SearchServer::SearchServer(const StringContainer& stop_words)
     }
 }
 
+template <typename QueryType>
+std::vector<std::string_view> SearchServer::MatchDocumentWords(const QueryType& query, int document_index) const {
+    const auto find_sorted_terms = [this](const auto& words) {
+        std::vector<TermId> term_ids;
+        for (const std::string_view word : words) {
+            const TermId term_id = dictionary_.Find(word);
+            if (term_id != NO_TERM) {
+                term_ids.push_back(term_id);
+            }
+        }
+        std::sort(term_ids.begin(), term_ids.end());
+        term_ids.erase(std::unique(term_ids.begin(), term_ids.end()), term_ids.end());
+        return term_ids;
+    };
+
+    const DocumentWords document_words = forward_index_.GetWords(document_index);
+    const TermId* document_terms = document_words.GetTermIds();
+    std::vector<TermId> matched_terms;
+    const std::vector<TermId> minus_terms = find_sorted_terms(query.minus_words);
+    std::set_intersection(minus_terms.begin(), minus_terms.end(), document_terms, document_terms + document_words.size(),
+                          std::back_inserter(matched_terms));
+    if (!matched_terms.empty()) {
+        return {};
+    }
+
+    const std::vector<TermId> plus_terms = find_sorted_terms(query.plus_words);
+    std::set_intersection(plus_terms.begin(), plus_terms.end(), document_terms, document_terms + document_words.size(),
+                          std::back_inserter(matched_terms));
+    std::vector<std::string_view> matched_words(matched_terms.size());
+    std::transform(matched_terms.begin(), matched_terms.end(), matched_words.begin(), [this](const TermId term_id) {
+        return dictionary_.GetTerm(term_id);
+    });
+    std::sort(matched_words.begin(), matched_words.end());
+    return matched_words;
+}
+
 template <typename ExecutionPolicy, typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, const std::string_view raw_query,
-                                                     DocumentPredicate document_predicate) const {
+                                                     DocumentPredicate document_predicate, int max_count) const {
 
-    std::vector<Document> result = FindAllDocuments(policy, raw_query, document_predicate);
+    return SelectTopDocuments(policy, FindAllDocuments(policy, raw_query, document_predicate), max_count);
+}
 
-    std::sort(policy, result.begin(), result.end(),
-            [](const Document &lhs, const Document &rhs){
-                if (std::abs(lhs.relevance - rhs.relevance) < INNACURATE) {
-                    return lhs.rating > rhs.rating;
-                }
-                else {
-                    return lhs.relevance > rhs.relevance;
+template <typename DocumentPredicate>
+const std::vector<Document>& SearchServer::FindTopDocuments(QueryContext& context, const std::string_view raw_query,
+                                                            DocumentPredicate document_predicate, int max_count) const {
+    ParseQuery(context, raw_query);
+    return SelectTopDocuments(context, context.query_, document_predicate, max_count);
+}
+
+template <typename DocumentPredicate>
+const std::vector<Document>& SearchServer::FindTopDocuments(QueryContext& context, PreparedQuery& query,
+                                                            DocumentPredicate document_predicate, int max_count) const {
+    if (query.index_version_ != index_version_) {
+        ResolveQuery(query.words_, query.query_);
+        query.index_version_ = index_version_;
+    }
+    return SelectTopDocuments(context, query.query_, document_predicate, max_count);
+}
+
+template <typename DocumentPredicate>
+const std::vector<Document>& SearchServer::SelectTopDocuments(QueryContext& context, const ResolvedQuery& query,
+                                                              DocumentPredicate document_predicate, int max_count) const {
+    context.top_.Reset(std::max(max_count, 0));
+    // the documents matched through the bitmap are already accepted
+    const uint64_t* status_bitmap = GetStatusBitmap(document_predicate);
+    ForEachSegment([&](const IndexSegment& segment) {
+        context.accumulator_.Reset(segment.GetBeginIndex(), segment.GetEndIndex());
+        AccumulateRelevance(query, segment, segment.GetBeginIndex(), segment.GetEndIndex(),
+                            status_bitmap, context.accumulator_);
+        SEARCH_PROBE(Probe::ACCUMULATION);
+        context.accumulator_.ForEachMatched([&](const int document_index, const double relevance) {
+            if (status_bitmap != nullptr || IsAccepted(document_predicate, document_index)) {
+                context.top_.Push(MakeDocument(document_index, relevance));
+            }
+        });
+    });
+    SEARCH_PROBE(Probe::TOP_K);
+    context.top_.ExtractTo(context.documents_);
+    return context.documents_;
+}
+
+template <typename DocumentPredicate>
+std::future<SearchResult> SearchServer::FindTopDocumentsAsync(QueryExecutor& executor, const std::string_view raw_query,
+                                                              const StopToken& stop_token, DocumentPredicate document_predicate,
+                                                              int max_count) const {
+    auto promise = std::make_shared<std::promise<SearchResult>>();
+    std::future<SearchResult> result = promise->get_future();
+    executor.Submit([this, query = std::string(raw_query), stop_token, document_predicate, max_count, promise] {
+        try {
+            if (stop_token.IsStopRequested()) {
+                promise->set_value({{}, true});
+                return;
+            }
+            QueryContext context;
+            ParseQuery(context, query);
+            promise->set_value(SelectTopDocuments(context, context.query_, document_predicate, max_count, stop_token));
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    });
+    return result;
+}
+
+template <typename DocumentPredicate>
+SearchResult SearchServer::SelectTopDocuments(QueryContext& context, const ResolvedQuery& query, DocumentPredicate document_predicate,
+                                              int max_count, const StopToken& stop_token) const {
+    SearchResult result;
+    context.top_.Reset(std::max(max_count, 0));
+    const uint64_t* status_bitmap = GetStatusBitmap(document_predicate);
+    ForEachSegment([&](const IndexSegment& segment) {
+        for (int begin_index = segment.GetBeginIndex(); begin_index < segment.GetEndIndex() && !result.is_truncated;
+             begin_index += STOP_CHECK_INTERVAL) {
+            if (stop_token.IsStopRequested()) {
+                result.is_truncated = true;
+                break;
+            }
+            // a document is summed over all the terms at once, so its relevance is final
+            const int end_index = std::min(segment.GetEndIndex(), begin_index + STOP_CHECK_INTERVAL);
+            context.accumulator_.Reset(begin_index, end_index);
+            AccumulateRelevance(query, segment, begin_index, end_index, status_bitmap, context.accumulator_);
+            SEARCH_PROBE(Probe::ACCUMULATION);
+            context.accumulator_.ForEachMatched([&](const int document_index, const double relevance) {
+                if (status_bitmap != nullptr || IsAccepted(document_predicate, document_index)) {
+                    context.top_.Push(MakeDocument(document_index, relevance));
                 }
             });
+        }
+    });
+    SEARCH_PROBE(Probe::TOP_K);
+    context.top_.ExtractTo(result.documents);
+    return result;
+}
 
-    if (result.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        result.resize(MAX_RESULT_DOCUMENT_COUNT);
+template <typename QueryType>
+void SearchServer::ResolveQuery(const QueryType& query, ResolvedQuery& resolved) const {
+    resolved.plus_terms.clear();
+    resolved.minus_terms.clear();
+    for (const std::string_view word : query.plus_words) {
+        const TermId term_id = dictionary_.Find(word);
+        if (term_id != NO_TERM && term_statistics_.GetDocumentFreq(term_id) != 0) {
+            resolved.plus_terms.push_back({term_id, ComputeWordInverseDocumentFreq(term_id)});
+        }
+    }
+    for (const std::string_view word : query.minus_words) {
+        const TermId term_id = dictionary_.Find(word);
+        if (term_id != NO_TERM) {
+            resolved.minus_terms.push_back(term_id);
+        }
     }
-    return result;
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const std::execution::parallel_policy &, const std::string_view raw_query, 
-                                                                                DocumentPredicate document_predicate) const {
+std::vector<Document> SearchServer::ScoreDocuments(const ResolvedQuery& query, DocumentPredicate document_predicate,
+                                                   const IndexSegment& segment, int begin_index, int end_index) const {
+    RelevanceAccumulator accumulator(begin_index, end_index);
+    // the documents matched through the bitmap are already accepted
+    const uint64_t* status_bitmap = GetStatusBitmap(document_predicate);
+    AccumulateRelevance(query, segment, begin_index, end_index, status_bitmap, accumulator);
+
+    SEARCH_PROBE(Probe::ACCUMULATION);
+    std::vector<Document> matched_documents;
+    matched_documents.reserve(accumulator.GetMatchedCount());
+    accumulator.ForEachMatched([&](const int document_index, const double relevance) {
+        if (status_bitmap != nullptr || IsAccepted(document_predicate, document_index)) {
+            matched_documents.push_back(MakeDocument(document_index, relevance));
+        }
+    });
+    return matched_documents;
+}
 
-    const QueryVect query = ParseQuery(std::execution::par, raw_query, true);
+// Block-Max MaxScore: terms are ordered by their maximal contribution, the lightest of them are
+// "non-essential" while all of them together can't lift a document into the current top.
+// Essential terms are summed term-at-a-time inside windows of document indexes, every candidate
+// of a window is then checked against the block maxima of the non-essential terms before their
+// postings are touched. Relevance of a document put into the top is always summed in the order of
+// query.plus_terms, so it is bit-identical to the one of ScoreDocuments.
+// Segments are searched one by one, the top and so the threshold pass from one segment to the next.
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::SelectTopDocumentsPruned(const ResolvedQuery& query, DocumentPredicate document_predicate,
+                                                             int max_count) const {
+    TopDocuments top(std::max(max_count, 0));
+    if (max_count <= 0 || query.plus_terms.empty()) {
+        return top.Extract();
+    }
+    ForEachSegment([&](const IndexSegment& segment) {
+        SelectTopDocumentsPruned(query, document_predicate, segment, top);
+    });
+    return top.Extract();
+}
 
-    ConcurrentMap<int, double> document_to_relevance(CONCURRENT_MAP_BUCKETS_COUNT);
+template <typename DocumentPredicate>
+void SearchServer::SelectTopDocumentsPruned(const ResolvedQuery& query, DocumentPredicate document_predicate,
+                                            const IndexSegment& segment, TopDocuments& top) const {
+    struct TermCursor {
+        PostingList::Cursor cursor;
+        double inverse_document_freq;
+        double max_score;
+        size_t query_position;
+    };
 
-    auto counter = [&] (std::string_view word) {
-    
-        if (word_to_document_freqs_.count(word) == 0) {
-            return;
+    std::vector<TermCursor> terms;
+    std::vector<PostingList::Cursor> exact_cursors;
+    terms.reserve(query.plus_terms.size());
+    exact_cursors.reserve(query.plus_terms.size());
+    for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+        const auto& [term_id, inverse_document_freq] = query.plus_terms[i];
+        const PostingList& postings = segment.GetPostings(term_id);
+        terms.push_back({postings.GetCursor(), inverse_document_freq, postings.GetMaxTermFreq() * inverse_document_freq, i});
+        exact_cursors.push_back(postings.GetCursor());
+    }
+    std::sort(terms.begin(), terms.end(), [](const TermCursor& lhs, const TermCursor& rhs) {
+        return lhs.max_score < rhs.max_score;
+    });
+
+    // max_score_prefix[i] bounds the total contribution of terms[0..i]
+    std::vector<double> max_score_prefix(terms.size());
+    for (size_t i = 0; i < terms.size(); ++i) {
+        max_score_prefix[i] = (i == 0 ? 0.0 : max_score_prefix[i - 1]) + terms[i].max_score;
+    }
+
+    std::vector<PostingList::Cursor> minus_cursors;
+    for (const TermId term_id : query.minus_terms) {
+        minus_cursors.push_back(segment.GetPostings(term_id).GetCursor());
+    }
+
+    const auto compute_exact_relevance = [&](const int document_index) {
+        double relevance = 0;
+        for (size_t i = 0; i < exact_cursors.size(); ++i) {
+            exact_cursors[i].Advance(document_index);
+            if (exact_cursors[i].GetDocumentId() == document_index) {
+                relevance += exact_cursors[i].GetTermFreq() * query.plus_terms[i].second;
+            }
         }
-        
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        auto& id_word = word_to_document_freqs_.at(word);
-
-        for_each(std::execution::par, id_word.begin(), id_word.end(), [&](const auto element) {
-            const auto& document_data = documents_.at(element.first);
-            if (document_predicate(element.first, document_data.status, document_data.rating)) {
-                document_to_relevance[element.first].ref_to_value += element.second * inverse_document_freq;
-            }});
+        return relevance;
     };
 
-    auto eraser = [&] (std::string_view word) {
-        for (const std::string_view word : query.minus_words) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                return;
-            }
-            for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-                document_to_relevance.Erase(document_id);
-            }
+    // a document within INNACURATE of the worst one still may win by rating, keep a margin for rounding too
+    const auto get_threshold = [&top]() {
+        return top.IsFull() ? top.GetWorst().relevance - 2 * INNACURATE : -std::numeric_limits<double>::infinity();
+    };
+    double threshold = get_threshold();
+    size_t first_essential = 0;
+    // essential terms are summed in query order, then a score without non-essential terms is already exact
+    std::vector<size_t> essential_order(terms.size());
+    std::iota(essential_order.begin(), essential_order.end(), 0);
+    std::sort(essential_order.begin(), essential_order.end(), [&terms](const size_t lhs, const size_t rhs) {
+        return terms[lhs].query_position < terms[rhs].query_position;
+    });
+
+    const auto update_essential_terms = [&]() {
+        const size_t old_first_essential = first_essential;
+        while (first_essential < terms.size() && max_score_prefix[first_essential] < threshold) {
+            ++first_essential;
+        }
+        if (first_essential != old_first_essential) {
+            essential_order.erase(std::remove_if(essential_order.begin(), essential_order.end(), [first_essential](const size_t i) {
+                return i < first_essential;
+            }), essential_order.end());
         }
     };
-    
-    std::for_each(std::execution::par, query.plus_words.begin(), query.plus_words.end(), counter);
+    // the top of the previous segments may already rule out some terms or the whole segment
+    update_essential_terms();
 
-    std::for_each(std::execution::par, query.minus_words.begin(), query.minus_words.end(), eraser);
-    
-    std::map<int, double> document_to_relevance_result = move(document_to_relevance.BuildOrdinaryMap());
+    std::vector<double> window_scores(PRUNING_WINDOW_SIZE, 0.0);
+    std::vector<uint64_t> window_touched(PRUNING_WINDOW_SIZE / 64, 0);
 
-    std::vector<Document> matched_documents(document_to_relevance_result.size());
-    std::transform(std::execution::par, document_to_relevance_result.begin(), document_to_relevance_result.end(), matched_documents.begin(), 
-                [&] (const auto& element) {
-                    return Document{element.first, element.second, documents_.at(element.first).rating};});
+    while (first_essential < terms.size()) {
+        int window_begin = POSTING_END_ID;
+        for (const size_t i : essential_order) {
+            window_begin = std::min(window_begin, terms[i].cursor.GetDocumentId());
+        }
+        if (window_begin == POSTING_END_ID) {
+            break;
+        }
+        const int window_end = window_begin + static_cast<int>(std::min<int64_t>(PRUNING_WINDOW_SIZE,
+                                                                                  POSTING_END_ID - window_begin));
+
+        for (const size_t i : essential_order) {
+            TermCursor& term = terms[i];
+            for (int document_index = term.cursor.GetDocumentId(); document_index < window_end;
+                 term.cursor.Next(), document_index = term.cursor.GetDocumentId()) {
+                const int offset = document_index - window_begin;
+                window_scores[offset] += term.cursor.GetTermFreq() * term.inverse_document_freq;
+                window_touched[offset / 64] |= uint64_t{1} << (offset % 64);
+            }
+        }
 
-    return matched_documents;
-}
+        const double non_essential_bound = first_essential == 0 ? 0.0 : max_score_prefix[first_essential - 1];
+        for (size_t word = 0; word < window_touched.size(); ++word) {
+            for (; window_touched[word] != 0; window_touched[word] &= window_touched[word] - 1) {
+                const int offset = static_cast<int>(word * 64) + __builtin_ctzll(window_touched[word]);
+                const int document_index = window_begin + offset;
+                double score = window_scores[offset];
+                window_scores[offset] = 0.0;
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const std::execution::sequenced_policy &, const std::string_view raw_query,
-                                                                                     DocumentPredicate document_predicate) const {
+                if (score + non_essential_bound < threshold || !IsAccepted(document_predicate, document_index)) {
+                    continue;
+                }
 
-    const Query query = ParseQuery(raw_query);
+                bool is_pruned = false;
+                bool has_non_essential = false;
+                for (size_t i = first_essential; i-- > 0;) {
+                    TermCursor& term = terms[i];
+                    const double rest_bound = i == 0 ? 0.0 : max_score_prefix[i - 1];
+                    if (score + max_score_prefix[i] < threshold
+                        || score + term.cursor.GetBlockMaxTermFreq(document_index) * term.inverse_document_freq + rest_bound < threshold) {
+                        is_pruned = true;
+                        break;
+                    }
+                    term.cursor.Advance(document_index);
+                    if (term.cursor.GetDocumentId() == document_index) {
+                        score += term.cursor.GetTermFreq() * term.inverse_document_freq;
+                        has_non_essential = true;
+                    }
+                }
+                if (is_pruned || score < threshold) {
+                    continue;
+                }
 
-    std::map<int, double> document_to_relevance;
-    for (const std::string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto &document_data = documents_.at(document_id);
+                if (std::any_of(minus_cursors.begin(), minus_cursors.end(), [document_index](PostingList::Cursor& cursor) {
+                        cursor.Advance(document_index);
+                        return cursor.GetDocumentId() == document_index;
+                    })) {
+                    continue;
+                }
 
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
+                const double relevance = has_non_essential ? compute_exact_relevance(document_index) : score;
+                top.Push(MakeDocument(document_index, relevance));
+                threshold = get_threshold();
             }
         }
+
+        // terms leave the essential set only between windows, their cursors are already past this one
+        update_essential_terms();
     }
+}
 
-    for (const std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindAllDocuments(const std::execution::parallel_policy &, const std::string_view raw_query, 
+                                                                                DocumentPredicate document_predicate) const {
+
+    const ResolvedQuery query = ParseResolvedQuery(std::execution::par, raw_query, true);
+    return FindAllDocuments(query, document_predicate, std::thread::hardware_concurrency() * 4, [](const size_t slice_count, const auto& func) {
+        std::vector<size_t> slices(slice_count);
+        std::iota(slices.begin(), slices.end(), 0);
+        std::for_each(std::execution::par, slices.begin(), slices.end(), func);
+    });
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(QueryExecutor& executor, const std::string_view raw_query,
+                                                     DocumentPredicate document_predicate, int max_count) const {
+    const ResolvedQuery query = ParseResolvedQuery(raw_query);
+    return SelectTopDocuments(std::execution::seq,
+                              FindAllDocuments(query, document_predicate, executor.GetThreadCount() * 4, [&executor](const size_t slice_count, const auto& func) {
+        executor.ParallelFor(slice_count, func);
+    }), max_count);
+}
+
+template <typename DocumentPredicate, typename ForEachSlice>
+std::vector<Document> SearchServer::FindAllDocuments(const ResolvedQuery& query, DocumentPredicate document_predicate,
+                                                     int64_t max_slice_count, ForEachSlice for_each_slice) const {
+    // segments get slices in proportion to their size, a slice never crosses a segment
+    struct ScoreRange {
+        const IndexSegment* segment;
+        int begin_index;
+        int end_index;
+    };
+    const int64_t document_count = std::max<int64_t>(1, document_attributes_.size());
+    const int64_t slice_count = std::max<int64_t>(1, std::min<int64_t>(document_count, max_slice_count));
+    std::vector<ScoreRange> ranges;
+    ForEachSegment([&](const IndexSegment& segment) {
+        const int64_t begin_index = segment.GetBeginIndex();
+        const int64_t segment_size = segment.GetEndIndex() - begin_index;
+        const int64_t segment_slice_count = std::max<int64_t>(1, segment_size * slice_count / document_count);
+        for (int64_t i = 0; i < segment_slice_count; ++i) {
+            ranges.push_back({&segment, static_cast<int>(begin_index + segment_size * i / segment_slice_count),
+                              static_cast<int>(begin_index + segment_size * (i + 1) / segment_slice_count)});
         }
-    }
+    });
+
+    std::vector<std::vector<Document>> slices(ranges.size());
+    for_each_slice(slices.size(), [&](const size_t slice) {
+        const ScoreRange& range = ranges[slice];
+        slices[slice] = ScoreDocuments(query, document_predicate, *range.segment, range.begin_index, range.end_index);
+    });
 
+    SEARCH_PROBE(Probe::RESULT_BUILDING);
     std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back({document_id, relevance, documents_.at(document_id).rating});
+    for (std::vector<Document>& slice : slices) {
+        matched_documents.insert(matched_documents.end(), slice.begin(), slice.end());
     }
     return matched_documents;
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindAllDocuments(const std::execution::sequenced_policy &, const std::string_view raw_query,
+                                                                                     DocumentPredicate document_predicate) const {
+
+    const ResolvedQuery query = ParseResolvedQuery(raw_query);
+    std::vector<Document> matched_documents;
+    ForEachSegment([&](const IndexSegment& segment) {
+        std::vector<Document> segment_documents = ScoreDocuments(query, document_predicate, segment,
+                                                                 segment.GetBeginIndex(), segment.GetEndIndex());
+        SEARCH_PROBE(Probe::RESULT_BUILDING);
+        if (matched_documents.empty()) {
+            matched_documents = std::move(segment_documents);
+        } else {
+            matched_documents.insert(matched_documents.end(), segment_documents.begin(), segment_documents.end());
+        }
+    });
+    return matched_documents;
 }
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include "snapshot.h"
+
+#include <cstdio>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path) {
+    const int descriptor = open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        throw std::invalid_argument("Can't open snapshot "s + path);
+    }
+
+    struct stat file_stat;
+    if (fstat(descriptor, &file_stat) != 0) {
+        close(descriptor);
+        throw std::invalid_argument("Can't read snapshot "s + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+
+    if (size_ != 0) {
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (data == MAP_FAILED) {
+            close(descriptor);
+            throw std::invalid_argument("Can't map snapshot "s + path);
+        }
+        data_ = static_cast<const char*>(data);
+    }
+    // the mapping stays valid after the descriptor is closed
+    close(descriptor);
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+SnapshotWriter::SnapshotWriter(const std::string& path)
+    : path_(path)
+    , temporary_path_(path + ".tmp"s)
+    , output_(temporary_path_, std::ios::binary | std::ios::trunc) {
+    if (!output_) {
+        throw std::invalid_argument("Can't create snapshot "s + path);
+    }
+}
+
+void SnapshotWriter::Finish() {
+    output_.close();
+    if (!output_ || std::rename(temporary_path_.c_str(), path_.c_str()) != 0) {
+        std::remove(temporary_path_.c_str());
+        throw std::invalid_argument("Can't write snapshot "s + path_);
+    }
+}
+
+const char* SnapshotReader::Take(size_t count, size_t element_size) {
+    const size_t position = SnapshotWriter::AlignUp(position_);
+    if (position > size_ || count > (size_ - position) / element_size) {
+        throw std::invalid_argument("Snapshot is truncated or corrupted"s);
+    }
+    position_ = position + count * element_size;
+    return data_ + position;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+using namespace std::string_literals;
+
+const char SNAPSHOT_MAGIC[8] = { 'S', 'R', 'C', 'H', 'S', 'N', 'A', 'P' };
+const uint32_t SNAPSHOT_VERSION = 5;
+// every value and array starts at this alignment, so the mapped data can be read in place
+const size_t SNAPSHOT_ALIGNMENT = 8;
+
+// Read-only memory mapping of a whole file, unmapped in the destructor.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    const char* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Writes trivially copyable values and arrays in the native layout, each aligned to SNAPSHOT_ALIGNMENT.
+// The data goes to a temporary file which replaces the target in Finish(), so a server
+// that still maps the old snapshot at the same path keeps reading it.
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const std::string& path);
+
+    template <typename T>
+    void WriteValue(const T& value) {
+        WriteArray(&value, 1);
+    }
+
+    template <typename T>
+    void WriteArray(const T* data, size_t count);
+
+    // the position the next value would get after alignment
+    size_t GetPosition() const {
+        return AlignUp(position_);
+    }
+
+    void Finish();
+
+    static size_t AlignUp(size_t position) {
+        return (position + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+    }
+
+private:
+    std::string path_;
+    std::string temporary_path_;
+    std::ofstream output_;
+    size_t position_ = 0;
+};
+
+// Reads what SnapshotWriter wrote, in the same order. Nothing is copied, the returned pointers
+// point into the data. Reading past the end throws std::invalid_argument.
+class SnapshotReader {
+public:
+    SnapshotReader(const char* data, size_t size)
+        : data_(data)
+        , size_(size) {
+    }
+
+    template <typename T>
+    const T& ReadValue() {
+        return *ReadArray<T>(1);
+    }
+
+    template <typename T>
+    const T* ReadArray(size_t count) {
+        static_assert(std::is_trivially_copyable_v<T>, "Snapshot supports only trivially copyable types"s);
+        return reinterpret_cast<const T*>(Take(count, sizeof(T)));
+    }
+
+    void Skip(size_t size) {
+        Take(size, 1);
+    }
+
+private:
+    const char* data_;
+    size_t size_;
+    size_t position_ = 0;
+
+    const char* Take(size_t count, size_t element_size);
+};
+
+template <typename T>
+void SnapshotWriter::WriteArray(const T* data, size_t count) {
+    static_assert(std::is_trivially_copyable_v<T>, "Snapshot supports only trivially copyable types"s);
+    const char padding[SNAPSHOT_ALIGNMENT] = {};
+    output_.write(padding, AlignUp(position_) - position_);
+    position_ = AlignUp(position_);
+    if (count != 0) {
+        output_.write(reinterpret_cast<const char*>(data), count * sizeof(T));
+        position_ += count * sizeof(T);
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+// Cooperative stop of a search: by Cancel() or once the deadline has passed. Copies share
+// the cancellation, so a caller keeps one copy and the search checks the other.
+class StopToken {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit StopToken(Clock::time_point deadline = Clock::time_point::max())
+        : deadline_(deadline) {
+    }
+
+    void Cancel() const {
+        is_cancelled_->store(true, std::memory_order_relaxed);
+    }
+
+    bool IsStopRequested() const {
+        return is_cancelled_->load(std::memory_order_relaxed)
+               || (deadline_ != Clock::time_point::max() && Clock::now() >= deadline_);
+    }
+
+    Clock::time_point GetDeadline() const {
+        return deadline_;
+    }
+
+private:
+    std::shared_ptr<std::atomic<bool>> is_cancelled_ = std::make_shared<std::atomic<bool>>(false);
+    Clock::time_point deadline_;
+};
@@ -1,31 +1,96 @@
 #include "string_processing.h"
 
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 using namespace std::string_literals;
 
-std::vector<std::string_view> SplitIntoWords(const std::string_view text) {
-    std::vector<std::string_view> words;
-    auto it = text.begin();
+namespace {
 
-    if (*it == ' ') {
-        it = std::find_if(text.begin(), text.end(), [](const char element) {return element != ' ';});
-    }
+// sets bit i of spaces for a space at data[i] and bit i of controls for a char in [0, 31]
+#if defined(__AVX2__)
+const size_t TOKENIZER_BLOCK_SIZE = 32;
+
+inline void ClassifyBlock(const char* data, uint64_t& spaces, uint64_t& controls) {
+    const __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+    const __m256i is_control = _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8(-1)),
+                                                _mm256_cmpgt_epi8(_mm256_set1_epi8(' '), chars));
+    spaces = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8(' '))));
+    controls = static_cast<uint32_t>(_mm256_movemask_epi8(is_control));
+}
+#elif defined(__SSE2__)
+const size_t TOKENIZER_BLOCK_SIZE = 16;
+
+inline void ClassifyBlock(const char* data, uint64_t& spaces, uint64_t& controls) {
+    const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    const __m128i is_control = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8(-1)),
+                                             _mm_cmplt_epi8(chars, _mm_set1_epi8(' ')));
+    spaces = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chars, _mm_set1_epi8(' '))));
+    controls = static_cast<uint32_t>(_mm_movemask_epi8(is_control));
+}
+#else
+const size_t TOKENIZER_BLOCK_SIZE = 64;
 
-    if (it == text.end()) {
-        return words;
+inline void ClassifyBlock(const char* data, uint64_t& spaces, uint64_t& controls) {
+    spaces = 0;
+    controls = 0;
+    for (size_t i = 0; i < TOKENIZER_BLOCK_SIZE; ++i) {
+        const signed char c = static_cast<signed char>(data[i]);
+        spaces |= static_cast<uint64_t>(c == ' ') << i;
+        controls |= static_cast<uint64_t>(c >= 0 && c < ' ') << i;
     }
+}
+#endif
 
-    while (it != text.end()) {
-        auto it_end = std::adjacent_find(it, text.end(), [] (const char lhs, const char rhs) {
-            return lhs != ' ' && rhs == ' ';});
+const uint64_t TOKENIZER_BLOCK_MASK = TOKENIZER_BLOCK_SIZE == 64 ? ~0ull : (1ull << TOKENIZER_BLOCK_SIZE) - 1;
 
-        it_end = it_end == text.end() ? it_end : std::next(it_end);
-        std::string_view word = text.substr(std::distance(text.begin(), it), std::distance(it, it_end));
+} // namespace
 
-        words.push_back(word);
-        
-        it = std::find_if(it_end , text.end(), [](const char element) {return element != ' ';});
+bool SplitIntoWords(const std::string_view text, std::vector<std::string_view>& words) {
+    words.clear();
+    uint64_t all_controls = 0;
+    bool is_in_word = false;
+    size_t word_begin = 0;
+    for (size_t block_begin = 0; block_begin < text.size(); block_begin += TOKENIZER_BLOCK_SIZE) {
+        uint64_t spaces = 0;
+        uint64_t controls = 0;
+        if (text.size() - block_begin >= TOKENIZER_BLOCK_SIZE) {
+            ClassifyBlock(text.data() + block_begin, spaces, controls);
+        } else {
+            // the tail is padded with spaces, they end the last word
+            char tail[TOKENIZER_BLOCK_SIZE];
+            std::memset(tail, ' ', TOKENIZER_BLOCK_SIZE);
+            std::memcpy(tail, text.data() + block_begin, text.size() - block_begin);
+            ClassifyBlock(tail, spaces, controls);
+        }
+        all_controls |= controls;
+
+        // a word begins or ends at every bit where a non-space follows a space or the other way round
+        const uint64_t word_chars = ~spaces & TOKENIZER_BLOCK_MASK;
+        uint64_t changes = (word_chars ^ ((word_chars << 1) | (is_in_word ? 1 : 0))) & TOKENIZER_BLOCK_MASK;
+        while (changes != 0) {
+            const size_t position = block_begin + __builtin_ctzll(changes);
+            if (is_in_word) {
+                words.push_back(text.substr(word_begin, position - word_begin));
+            } else {
+                word_begin = position;
+            }
+            is_in_word = !is_in_word;
+            changes &= changes - 1;
+        }
+    }
+    if (is_in_word) {
+        words.push_back(text.substr(word_begin));
     }
+    return all_controls == 0;
+}
 
+std::vector<std::string_view> SplitIntoWords(const std::string_view text) {
+    std::vector<std::string_view> words;
+    SplitIntoWords(text, words);
     return words;
 }
-
@@ -1,10 +1,16 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <string_view>
 #include <set>
 #include <stdexcept>
 #include <algorithm>
 
+// Splits the text by spaces into words, the buffer is cleared first and may be reused between calls.
+// Checks for control chars [0, 31] in the same pass: returns false if there are any, the words are complete anyway.
+// Works on blocks of 16 (SSE2) or 32 (AVX2) chars, or 64 in the scalar fallback
+bool SplitIntoWords(const std::string_view text, std::vector<std::string_view>& words);
+
 std::vector<std::string_view> SplitIntoWords(const std::string_view text);
 
 
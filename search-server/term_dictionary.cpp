@@ -0,0 +1,118 @@
+#include "term_dictionary.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+TermId TermDictionary::Intern(std::string_view word) {
+    const auto it = ids_.find(word);
+    if (it != ids_.end()) {
+        return it->second;
+    }
+
+    if (mapped_term_count_ != 0) {
+        const TermId term_id = FindMapped(word);
+        if (term_id != NO_TERM) {
+            return term_id;
+        }
+    }
+
+    const std::string_view stored = Store(word);
+    const TermId term_id = static_cast<TermId>(size());
+    terms_.push_back(stored);
+    ids_.emplace(stored, term_id);
+    return term_id;
+}
+
+std::string_view TermDictionary::Store(std::string_view word) {
+    if (word.size() > TERM_ARENA_BLOCK_SIZE) {
+        // an oversized word gets its own block, the current block stays open
+        large_blocks_.push_back(std::make_unique<char[]>(word.size()));
+        char* data = large_blocks_.back().get();
+        std::memcpy(data, word.data(), word.size());
+        return {data, word.size()};
+    }
+
+    if (TERM_ARENA_BLOCK_SIZE - block_used_ < word.size()) {
+        blocks_.push_back(std::make_unique<char[]>(TERM_ARENA_BLOCK_SIZE));
+        block_used_ = 0;
+    }
+
+    char* data = blocks_.back().get() + block_used_;
+    std::memcpy(data, word.data(), word.size());
+    block_used_ += word.size();
+    return {data, word.size()};
+}
+
+TermId TermDictionary::FindMapped(std::string_view word) const {
+    for (size_t slot = Hash(word) & mapped_table_mask_; mapped_table_[slot] != NO_TERM; slot = (slot + 1) & mapped_table_mask_) {
+        if (GetTerm(mapped_table_[slot]) == word) {
+            return mapped_table_[slot];
+        }
+    }
+    return NO_TERM;
+}
+
+void TermDictionary::Save(SnapshotWriter& writer) const {
+    const uint64_t term_count = size();
+    std::vector<uint64_t> offsets;
+    offsets.reserve(term_count + 1);
+    offsets.push_back(0);
+    for (TermId term_id = 0; static_cast<uint64_t>(term_id) < term_count; ++term_id) {
+        offsets.push_back(offsets.back() + GetTerm(term_id).size());
+    }
+
+    // at most a half of the slots is occupied
+    uint64_t table_size = 1;
+    while (table_size < term_count * 2) {
+        table_size *= 2;
+    }
+    std::vector<TermId> table(table_size, NO_TERM);
+    for (TermId term_id = 0; static_cast<uint64_t>(term_id) < term_count; ++term_id) {
+        size_t slot = Hash(GetTerm(term_id)) & (table_size - 1);
+        while (table[slot] != NO_TERM) {
+            slot = (slot + 1) & (table_size - 1);
+        }
+        table[slot] = term_id;
+    }
+
+    std::string chars;
+    chars.reserve(offsets.back());
+    for (TermId term_id = 0; static_cast<uint64_t>(term_id) < term_count; ++term_id) {
+        chars += GetTerm(term_id);
+    }
+
+    writer.WriteValue(term_count);
+    writer.WriteValue(table_size);
+    writer.WriteArray(offsets.data(), offsets.size());
+    writer.WriteArray(table.data(), table.size());
+    writer.WriteArray(chars.data(), chars.size());
+}
+
+TermDictionary TermDictionary::Map(SnapshotReader& reader) {
+    TermDictionary dictionary;
+    const uint64_t term_count = reader.ReadValue<uint64_t>();
+    const uint64_t table_size = reader.ReadValue<uint64_t>();
+    if (table_size == 0 || (table_size & (table_size - 1)) != 0 || table_size <= term_count) {
+        throw std::invalid_argument("Snapshot is truncated or corrupted"s);
+    }
+    dictionary.mapped_offsets_ = reader.ReadArray<uint64_t>(term_count + 1);
+    dictionary.mapped_table_ = reader.ReadArray<TermId>(table_size);
+    const uint64_t chars_size = dictionary.mapped_offsets_[term_count];
+    dictionary.mapped_chars_ = reader.ReadArray<char>(chars_size);
+    // every term lies inside the characters, every slot is empty or a term, and an empty slot ends every probe
+    const uint64_t* offsets = dictionary.mapped_offsets_;
+    const TermId* table = dictionary.mapped_table_;
+    if (offsets[0] != 0 || !std::is_sorted(offsets, offsets + term_count + 1)
+        || std::any_of(table, table + table_size, [term_count](const TermId term_id) {
+               return term_id != NO_TERM && (term_id < 0 || static_cast<uint64_t>(term_id) >= term_count);
+           })
+        || std::none_of(table, table + table_size, [](const TermId term_id) {
+               return term_id == NO_TERM;
+           })) {
+        throw std::invalid_argument("Snapshot is truncated or corrupted"s);
+    }
+    dictionary.mapped_term_count_ = term_count;
+    dictionary.mapped_table_mask_ = table_size - 1;
+    return dictionary;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "snapshot.h"
+
+using TermId = int;
+
+const TermId NO_TERM = -1;
+const size_t TERM_ARENA_BLOCK_SIZE = 64 * 1024;
+
+// Interns every word once. Strings live in arena blocks that are never moved or freed,
+// so the returned string_view stays valid for the lifetime of the dictionary.
+// Term ids are dense: 0, 1, 2, ... in order of first appearance.
+// A dictionary mapped from a snapshot looks its terms up in the mapped hash table,
+// words interned after that get the next ids and live in the arena as usual.
+class TermDictionary {
+public:
+    TermDictionary() = default;
+
+    TermDictionary(const TermDictionary&) = delete;
+    TermDictionary& operator=(const TermDictionary&) = delete;
+
+    TermDictionary(TermDictionary&&) = default;
+    TermDictionary& operator=(TermDictionary&&) = default;
+
+    TermId Intern(std::string_view word);
+
+    TermId Find(std::string_view word) const {
+        if (mapped_term_count_ != 0) {
+            const TermId term_id = FindMapped(word);
+            if (term_id != NO_TERM) {
+                return term_id;
+            }
+        }
+        const auto it = ids_.find(word);
+        return it == ids_.end() ? NO_TERM : it->second;
+    }
+
+    std::string_view GetTerm(TermId term_id) const {
+        if (static_cast<size_t>(term_id) < mapped_term_count_) {
+            return {mapped_chars_ + mapped_offsets_[term_id], mapped_offsets_[term_id + 1] - mapped_offsets_[term_id]};
+        }
+        return terms_[term_id - mapped_term_count_];
+    }
+
+    size_t size() const {
+        return mapped_term_count_ + terms_.size();
+    }
+
+    void Save(SnapshotWriter& writer) const;
+
+    // the dictionary refers to the reader's data, which must outlive it
+    static TermDictionary Map(SnapshotReader& reader);
+
+private:
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    std::vector<std::unique_ptr<char[]>> large_blocks_;
+    size_t block_used_ = TERM_ARENA_BLOCK_SIZE;
+    std::vector<std::string_view> terms_;
+    std::unordered_map<std::string_view, TermId> ids_;
+    // the terms of the snapshot: characters, term_id -> offset, open addressing table of term ids
+    size_t mapped_term_count_ = 0;
+    const uint64_t* mapped_offsets_ = nullptr;
+    const char* mapped_chars_ = nullptr;
+    const TermId* mapped_table_ = nullptr;
+    size_t mapped_table_mask_ = 0;
+
+    std::string_view Store(std::string_view word);
+
+    TermId FindMapped(std::string_view word) const;
+
+    // FNV-1a, unlike std::hash it is the same for every build reading the snapshot
+    static uint64_t Hash(std::string_view word) {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (const char c : word) {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+};
@@ -0,0 +1,55 @@
+#include "term_statistics.h"
+
+#include <algorithm>
+
+TermStatistics::TermStatistics(TermStatistics&& other) noexcept
+    : document_freqs_(std::move(other.document_freqs_))
+    , max_term_freqs_(std::move(other.max_term_freqs_)) {
+}
+
+TermStatistics& TermStatistics::operator=(TermStatistics&& other) noexcept {
+    document_freqs_ = std::move(other.document_freqs_);
+    max_term_freqs_ = std::move(other.max_term_freqs_);
+    inverse_document_freqs_.clear();
+    idf_document_count_.store(NO_DOCUMENT_COUNT, std::memory_order_relaxed);
+    return *this;
+}
+
+void TermStatistics::Resize(size_t term_count) {
+    document_freqs_.resize(term_count, 0);
+    max_term_freqs_.resize(term_count, 0.0);
+    // a new term has no documents and so no IDF yet
+    if (idf_document_count_.load(std::memory_order_relaxed) != NO_DOCUMENT_COUNT) {
+        inverse_document_freqs_.resize(term_count, 0.0);
+    }
+}
+
+void TermStatistics::AddDocuments(TermId term_id, int document_count, double max_term_freq) {
+    document_freqs_[term_id] += document_count;
+    max_term_freqs_[term_id] = std::max(max_term_freqs_[term_id], max_term_freq);
+    UpdateInverseDocumentFreq(term_id);
+}
+
+void TermStatistics::RemoveDocuments(TermId term_id, int document_count) {
+    document_freqs_[term_id] -= document_count;
+    UpdateInverseDocumentFreq(term_id);
+}
+
+void TermStatistics::UpdateInverseDocumentFreq(TermId term_id) {
+    const int idf_document_count = idf_document_count_.load(std::memory_order_relaxed);
+    if (idf_document_count != NO_DOCUMENT_COUNT) {
+        inverse_document_freqs_[term_id] = ComputeInverseDocumentFreq(idf_document_count, document_freqs_[term_id]);
+    }
+}
+
+void TermStatistics::UpdateInverseDocumentFreqs(int document_count) const {
+    std::lock_guard guard(idf_mutex_);
+    if (idf_document_count_.load(std::memory_order_relaxed) == document_count) {
+        return;
+    }
+    inverse_document_freqs_.resize(document_freqs_.size());
+    for (size_t term_id = 0; term_id < document_freqs_.size(); ++term_id) {
+        inverse_document_freqs_[term_id] = ComputeInverseDocumentFreq(document_count, document_freqs_[term_id]);
+    }
+    idf_document_count_.store(document_count, std::memory_order_release);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <vector>
+
+#include "term_dictionary.h"
+
+// Per term id: the number of live documents with the term, its IDF and the largest term freq.
+// IDF of all terms are kept in a table computed for one document count as log(document_count * 1.0 / document_freq),
+// the formula of the relevance, so the values are the same to the bit. A change of a term updates its entry only,
+// a new document count outdates the table and the first reader after it recomputes the whole table at once,
+// so a search gets the IDF of a term in O(1) without a logarithm.
+// Changes must not run concurrently with reads, reads may run concurrently with each other.
+class TermStatistics {
+public:
+    TermStatistics() = default;
+
+    TermStatistics(TermStatistics&& other) noexcept;
+    TermStatistics& operator=(TermStatistics&& other) noexcept;
+
+    size_t size() const {
+        return document_freqs_.size();
+    }
+
+    // new terms get no documents
+    void Resize(size_t term_count);
+
+    // document_count more live documents have the term, max_term_freq is the largest term freq among them.
+    // Different terms may be changed concurrently
+    void AddDocuments(TermId term_id, int document_count, double max_term_freq);
+
+    void RemoveDocument(TermId term_id) {
+        RemoveDocuments(term_id, 1);
+    }
+
+    // document_count of the live documents with the term are removed
+    void RemoveDocuments(TermId term_id, int document_count);
+
+    int GetDocumentFreq(TermId term_id) const {
+        return document_freqs_[term_id];
+    }
+
+    // the largest term freq of the term in the documents ever added, so a bound for the live ones
+    double GetMaxTermFreq(TermId term_id) const {
+        return max_term_freqs_[term_id];
+    }
+
+    // log(document_count * 1.0 / document_freq), for a term in at least one live document
+    double GetInverseDocumentFreq(TermId term_id, int document_count) const {
+        if (idf_document_count_.load(std::memory_order_acquire) != document_count) {
+            UpdateInverseDocumentFreqs(document_count);
+        }
+        return inverse_document_freqs_[term_id];
+    }
+
+    const std::vector<int>& GetDocumentFreqs() const {
+        return document_freqs_;
+    }
+
+private:
+    static const int NO_DOCUMENT_COUNT = -1;
+
+    std::vector<int> document_freqs_;
+    std::vector<double> max_term_freqs_;
+    // valid for idf_document_count_ unless it is NO_DOCUMENT_COUNT
+    mutable std::vector<double> inverse_document_freqs_;
+    mutable std::atomic<int> idf_document_count_{NO_DOCUMENT_COUNT};
+    mutable std::mutex idf_mutex_;
+
+    static double ComputeInverseDocumentFreq(int document_count, int document_freq) {
+        return document_freq == 0 ? 0.0 : std::log(document_count * 1.0 / document_freq);
+    }
+
+    // keeps the table valid after a change of the term
+    void UpdateInverseDocumentFreq(TermId term_id);
+
+    void UpdateInverseDocumentFreqs(int document_count) const;
+};
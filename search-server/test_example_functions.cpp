@@ -1,9 +1,15 @@
 #include "test_example_functions.h"
 
 using namespace std::string_literals;
+using namespace std::string_view_literals;
 
 const double INACCURACY = 1e-6;
 
+// the view is ordered by term ids, which depend on the order words were added in
+std::map<std::string_view, double> ToMap(const WordFrequencies& word_frequencies) {
+    return {word_frequencies.begin(), word_frequencies.end()};
+}
+
 void AssertImpl(const bool value, const std::string& expr, const std::string& file, const std::string& func, 
                 unsigned line, const std::string& hint) {
     if (!value) {
@@ -251,7 +257,1422 @@ void TestComputeRelevance() {
     }
 }
 
+void TestTermDictionary() {
+    TermDictionary dictionary;
+    const TermId cat_id = dictionary.Intern("cat"s);
+    const TermId dog_id = dictionary.Intern("dog"s);
+    const std::string long_word(TERM_ARENA_BLOCK_SIZE + 1, 'a');
+    const TermId long_id = dictionary.Intern(long_word);
+
+    ASSERT_EQUAL(cat_id, 0);
+    ASSERT_EQUAL(dog_id, 1);
+    ASSERT_EQUAL_HINT(dictionary.Intern("cat"s), cat_id, "Word must be interned once"s);
+    ASSERT_EQUAL(dictionary.size(), 3);
+    ASSERT_EQUAL(dictionary.Find("dog"s), dog_id);
+    ASSERT_EQUAL(dictionary.Find("cow"s), NO_TERM);
+    ASSERT(dictionary.GetTerm(long_id) == long_word);
+
+    {
+        SearchServer server(""s);
+        server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+        std::vector<std::string_view> matched_words;
+        {
+            const std::string query = "cat white"s;
+            matched_words = std::get<0>(server.MatchDocument(query, 1));
+        }
+        ASSERT_EQUAL(matched_words.size(), 2);
+        ASSERT_HINT(matched_words[0] == "cat"s && matched_words[1] == "white"s,
+                    "Matched words must point to the server storage, not to the query"s);
+    }
+}
+
+void TestPostingList() {
+    for (const PostingFormat format : { PostingFormat::RAW, PostingFormat::COMPRESSED }) {
+        PostingList postings(format);
+        for (const int document_id : { 1, 3, 7, 5 }) {
+            postings.Add(document_id, 1, document_id);
+        }
+
+        std::vector<int> document_ids;
+        postings.ForEach([&document_ids](const int document_id, double) { document_ids.push_back(document_id); });
+        ASSERT_HINT((document_ids == std::vector<int>{ 1, 3, 5, 7 }), "Postings must be sorted by document id"s);
+        ASSERT_EQUAL(postings.size(), 4);
+    }
+
+    // several full blocks and an out of order add in the middle
+    PostingList raw_postings(PostingFormat::RAW);
+    PostingList compressed_postings(PostingFormat::COMPRESSED);
+    for (PostingList* postings : { &raw_postings, &compressed_postings }) {
+        for (int document_id = 0; document_id < 1000; document_id += 3) {
+            postings->Add(document_id, document_id % 4 + 1, document_id % 9 + 4);
+        }
+        postings->Add(400, 2, 7);
+    }
+    ASSERT_EQUAL(raw_postings.size(), compressed_postings.size());
+    ASSERT_HINT(compressed_postings.GetMemoryUsage() < raw_postings.GetMemoryUsage(), "Compressed postings must be smaller"s);
+
+    std::vector<std::pair<int, double>> raw_entries;
+    std::vector<std::pair<int, double>> compressed_entries;
+    raw_postings.ForEach(100, 900, [&](const int document_id, const double term_freq) { raw_entries.push_back({document_id, term_freq}); });
+    compressed_postings.ForEach(100, 900, [&](const int document_id, const double term_freq) {
+        compressed_entries.push_back({document_id, term_freq});
+    });
+    ASSERT_HINT(raw_entries == compressed_entries, "Compressed postings must restore the same term freqs"s);
+
+    PostingList::Cursor raw_cursor = raw_postings.GetCursor();
+    PostingList::Cursor compressed_cursor = compressed_postings.GetCursor();
+    for (const int target : { 5, 6, 30, 31, 400, 401, 777, 999, 2000 }) {
+        raw_cursor.Advance(target);
+        compressed_cursor.Advance(target);
+        ASSERT_EQUAL_HINT(raw_cursor.GetDocumentId(), compressed_cursor.GetDocumentId(), "Cursor advance to "s + std::to_string(target));
+    }
+
+    // a shrunk list seals its tail into a shorter last block, the next add opens it again
+    const size_t tail_memory_usage = compressed_postings.GetMemoryUsage();
+    compressed_postings.ShrinkToFit();
+    ASSERT(compressed_postings.GetMemoryUsage() < tail_memory_usage);
+    for (const int document_id : { 1000, 1001 }) {
+        std::vector<std::pair<int, double>> raw_all_entries;
+        std::vector<std::pair<int, double>> compressed_all_entries;
+        raw_postings.ForEach([&](const int id, const double term_freq) { raw_all_entries.push_back({id, term_freq}); });
+        compressed_postings.ForEach([&](const int id, const double term_freq) { compressed_all_entries.push_back({id, term_freq}); });
+        ASSERT_HINT(raw_all_entries == compressed_all_entries, "A sealed tail must keep the postings"s);
+        PostingList::Cursor cursor = compressed_postings.GetCursor();
+        cursor.Advance(raw_all_entries.back().first);
+        ASSERT_EQUAL(cursor.GetDocumentId(), raw_all_entries.back().first);
+        raw_postings.Add(document_id, 1, 2);
+        compressed_postings.Add(document_id, 1, 2);
+    }
+    ASSERT_EQUAL(raw_postings.size(), compressed_postings.size());
+
+    SearchServer server(""s);
+    server.AddDocument(1, "grey cat"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "white cat"s, DocumentStatus::ACTUAL, {2});
+    server.RemoveDocument(1);
+    const auto found_docs = server.FindTopDocuments("cat"s);
+    ASSERT_EQUAL(found_docs.size(), 1);
+    ASSERT_EQUAL(found_docs[0].id, 2);
+    server.RemoveDocument(std::execution::par, 2);
+    ASSERT_HINT(server.FindTopDocuments(std::execution::par, "cat"s).empty(), "Removed document is found"s);
+}
+
+void TestTopDocumentsCount() {
+    SearchServer server(""s);
+    for (int id = 0; id < 20; ++id) {
+        server.AddDocument(id, "cat"s + std::string(id % 4, 's') + " lives here"s, DocumentStatus::ACTUAL, {id % 7});
+    }
+
+    const auto found_docs = server.FindTopDocuments("cat lives"s);
+    ASSERT_EQUAL_HINT(found_docs.size(), MAX_RESULT_DOCUMENT_COUNT, "Default result count is MAX_RESULT_DOCUMENT_COUNT"s);
+
+    const auto found_docs_three = server.FindTopDocuments("cat lives"s, DocumentStatus::ACTUAL, 3);
+    const auto found_docs_three_par = server.FindTopDocuments(std::execution::par, "cat lives"s, DocumentStatus::ACTUAL, 3);
+    ASSERT_EQUAL(found_docs_three.size(), 3);
+    ASSERT_EQUAL(found_docs_three_par.size(), 3);
+
+    const auto found_docs_all = server.FindTopDocuments("cat lives"s, [](int, DocumentStatus, int) { return true; }, 100);
+    const auto found_docs_all_par = server.FindTopDocuments(std::execution::par, "cat lives"s, 
+                                                            [](int, DocumentStatus, int) { return true; }, 100);
+    ASSERT_EQUAL(found_docs_all.size(), 20);
+    ASSERT_EQUAL(found_docs_all_par.size(), 20);
+    for (size_t i = 0; i < found_docs_all.size(); ++i) {
+        ASSERT_HINT(found_docs_all[i].id == found_docs_all_par[i].id, "Par version must keep the same order"s);
+        if (i > 0) {
+            ASSERT_HINT(!IsMoreRelevant(found_docs_all[i], found_docs_all[i - 1]), "Documents must be sorted by relevance"s);
+        }
+        if (i < 3) {
+            ASSERT_EQUAL_HINT(found_docs_three[i].id, found_docs_all[i].id, "Top 3 must be a prefix of the full result"s);
+        }
+    }
+
+    ASSERT(server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, 0).empty());
+}
+
+void TestParallelScoring() {
+    SearchServer server("and"s);
+    const std::vector<std::string> words = { "red"s, "green"s, "blue"s, "cat"s, "dog"s, "bird"s, "and"s };
+    for (int id = 0; id < 200; ++id) {
+        std::string content;
+        for (int i = 0; i < 6; ++i) {
+            content += words[(id * 7 + i * i * 3 + i) % words.size()] + " "s;
+        }
+        server.AddDocument(id * 3, content, id % 5 ? DocumentStatus::ACTUAL : DocumentStatus::BANNED, {id % 11});
+    }
+    server.RemoveDocument(30);
+
+    for (const std::string& query : { "red cat"s, "blue -unknown -dog"s, "green bird and -red"s, "cat dog bird"s }) {
+        const auto found_docs = server.FindTopDocuments(query, DocumentStatus::ACTUAL, 1000);
+        const auto found_docs_par = server.FindTopDocuments(std::execution::par, query, DocumentStatus::ACTUAL, 1000);
+        ASSERT_EQUAL_HINT(found_docs.size(), found_docs_par.size(), query);
+        for (size_t i = 0; i < found_docs.size(); ++i) {
+            ASSERT_HINT(found_docs[i].id == found_docs_par[i].id && found_docs[i].relevance == found_docs_par[i].relevance,
+                        "Par version must compute the same relevance: "s + query);
+            ASSERT_HINT(found_docs[i].id != 30, "Removed document is found"s);
+        }
+    }
+    ASSERT_HINT(server.FindTopDocuments(std::execution::par, "blue -unknown -dog"s, DocumentStatus::ACTUAL, 1000).size() <
+                server.FindTopDocuments(std::execution::par, "blue"s, DocumentStatus::ACTUAL, 1000).size(),
+                "Minus word after an unknown minus word is ignored"s);
+}
+
+void TestPrunedSearch() {
+    std::mt19937 generator(7);
+    std::vector<std::string> words;
+    for (int i = 0; i < 60; ++i) {
+        words.push_back("w"s + std::to_string(i));
+    }
+    // skewed word distribution, so terms get very different maximal contributions
+    const auto random_word = [&] {
+        const int rank = std::uniform_int_distribution<int>(0, 59)(generator);
+        return words[rank * rank / 60];
+    };
+
+    SearchServer server("w0"s);
+    for (int id = 0; id < 3000; ++id) {
+        std::string content;
+        const int length = std::uniform_int_distribution<int>(1, 30)(generator);
+        for (int i = 0; i < length; ++i) {
+            content += random_word() + " "s;
+        }
+        const DocumentStatus status = id % 7 == 0 ? DocumentStatus::IRRELEVANT : DocumentStatus::ACTUAL;
+        server.AddDocument(id, content, status, {id % 13, id % 5});
+    }
+    for (int id = 0; id < 3000; id += 11) {
+        server.RemoveDocument(id);
+    }
+
+    for (int q = 0; q < 200; ++q) {
+        std::string query;
+        const int length = std::uniform_int_distribution<int>(1, 8)(generator);
+        for (int i = 0; i < length; ++i) {
+            query += (i > 0 && q % 3 == 0 && i % 4 == 0 ? "-"s : ""s) + random_word() + " "s;
+        }
+        const int max_count = 1 + q % 12;
+        const auto expected = server.FindTopDocuments(query, DocumentStatus::ACTUAL, max_count);
+        const auto found_docs = server.FindTopDocumentsPruned(query, DocumentStatus::ACTUAL, max_count);
+        const auto even_rating = [](int, DocumentStatus, int rating) { return rating % 2 == 0; };
+        const auto expected_filtered = server.FindTopDocuments(query, even_rating, max_count);
+        const auto found_docs_filtered = server.FindTopDocumentsPruned(query, even_rating, max_count);
+
+        ASSERT_EQUAL_HINT(found_docs.size(), expected.size(), query);
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_HINT(found_docs[i].id == expected[i].id && found_docs[i].relevance == expected[i].relevance,
+                        "Pruned search must match the exhaustive one: "s + query);
+        }
+        ASSERT_EQUAL_HINT(found_docs_filtered.size(), expected_filtered.size(), query);
+        for (size_t i = 0; i < expected_filtered.size(); ++i) {
+            ASSERT_HINT(found_docs_filtered[i].id == expected_filtered[i].id 
+                        && found_docs_filtered[i].relevance == expected_filtered[i].relevance,
+                        "Pruned search with predicate must match the exhaustive one: "s + query);
+        }
+    }
+}
+
+void TestCompressedIndex() {
+    const std::vector<std::string> contents = { "white cat and fashionable collar"s, "fluffy cat fluffy tail"s, 
+                                                "groomed dog expressive eyes"s, "groomed starling eugene"s };
+    SearchServer raw_server("and"s);
+    SearchServer compressed_server("and"s, PostingFormat::COMPRESSED);
+    for (int id = 0; id < 500; ++id) {
+        raw_server.AddDocument(id, contents[id % 4] + " "s + contents[id * 7 % 4], DocumentStatus::ACTUAL, {id % 10});
+        compressed_server.AddDocument(id, contents[id % 4] + " "s + contents[id * 7 % 4], DocumentStatus::ACTUAL, {id % 10});
+    }
+    for (int id = 0; id < 500; id += 7) {
+        raw_server.RemoveDocument(id);
+        compressed_server.RemoveDocument(id);
+    }
+
+    for (const std::string& query : { "fluffy groomed cat"s, "dog -eyes"s, "collar tail starling"s }) {
+        const auto raw_docs = raw_server.FindTopDocuments(query, DocumentStatus::ACTUAL, 50);
+        const auto compressed_docs = compressed_server.FindTopDocuments(query, DocumentStatus::ACTUAL, 50);
+        const auto compressed_pruned_docs = compressed_server.FindTopDocumentsPruned(query, DocumentStatus::ACTUAL, 50);
+        ASSERT_EQUAL(raw_docs.size(), compressed_docs.size());
+        ASSERT_EQUAL(raw_docs.size(), compressed_pruned_docs.size());
+        for (size_t i = 0; i < raw_docs.size(); ++i) {
+            ASSERT_HINT(raw_docs[i].id == compressed_docs[i].id && raw_docs[i].relevance == compressed_docs[i].relevance,
+                        "Compressed index must give the same result: "s + query);
+            ASSERT_HINT(raw_docs[i].id == compressed_pruned_docs[i].id && raw_docs[i].relevance == compressed_pruned_docs[i].relevance,
+                        "Pruned search over compressed index must give the same result: "s + query);
+        }
+    }
+    ASSERT(compressed_server.GetPostingCount() == raw_server.GetPostingCount());
+    ASSERT(compressed_server.GetPostingsMemoryUsage() < raw_server.GetPostingsMemoryUsage());
+}
+
+void TestSnapshot() {
+    const std::string path = (std::filesystem::temp_directory_path() / "search_server_test.snapshot"s).string();
+    const std::vector<std::string> contents = { "white cat and fashionable collar"s, "fluffy cat fluffy tail"s,
+                                                "groomed dog expressive eyes"s, "groomed starling eugene"s };
+    const std::vector<std::string> queries = { "fluffy groomed cat"s, "dog -eyes"s, "collar tail starling"s, "unknown"s };
+
+    for (const PostingFormat format : { PostingFormat::RAW, PostingFormat::COMPRESSED }) {
+        SearchServer server("and with"s, format);
+        for (int id = 0; id < 300; ++id) {
+            server.AddDocument(id * 3, contents[id % 4] + " "s + contents[id * 7 % 4], 
+                               id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, {id % 10});
+        }
+        for (int id = 0; id < 900; id += 21) {
+            server.RemoveDocument(id);
+        }
+        server.SaveSnapshot(path);
+
+        SearchServer loaded = SearchServer::LoadSnapshot(path);
+        ASSERT_EQUAL(loaded.GetDocumentCount(), server.GetDocumentCount());
+        ASSERT_HINT(std::equal(loaded.begin(), loaded.end(), server.begin(), server.end()), "Snapshot must keep the document ids"s);
+        ASSERT(loaded.GetPostingCount() == server.GetPostingCount());
+
+        for (const std::string& query : queries) {
+            for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+                const auto expected = server.FindTopDocuments(query, status, 20);
+                const auto found = loaded.FindTopDocuments(query, status, 20);
+                const auto found_pruned = loaded.FindTopDocumentsPruned(query, status, 20);
+                ASSERT_EQUAL(expected.size(), found.size());
+                ASSERT_EQUAL(expected.size(), found_pruned.size());
+                for (size_t i = 0; i < expected.size(); ++i) {
+                    ASSERT_HINT(expected[i].id == found[i].id && expected[i].relevance == found[i].relevance
+                                && expected[i].rating == found[i].rating, "Loaded server must give the same result: "s + query);
+                    ASSERT_HINT(expected[i].id == found_pruned[i].id, "Loaded server must give the same pruned result: "s + query);
+                }
+            }
+        }
+        ASSERT(ToMap(loaded.GetWordFrequencies(3)) == ToMap(server.GetWordFrequencies(3)));
+        ASSERT(loaded.MatchDocument("fluffy cat -dog"s, 3) == server.MatchDocument("fluffy cat -dog"s, 3));
+        ASSERT(loaded.MatchDocument(std::execution::par, "fluffy cat"s, 3) == server.MatchDocument(std::execution::par, "fluffy cat"s, 3));
+        ASSERT_HINT(loaded.FindTopDocuments("with"s).empty(), "Stop words must be kept in the snapshot"s);
+
+        // the loaded server stays writable, new words get new ids
+        loaded.RemoveDocument(3);
+        loaded.AddDocument(3, "fluffy parrot"s, DocumentStatus::ACTUAL, {100});
+        loaded.AddDocument(1000, "fluffy parrot parrot"s, DocumentStatus::ACTUAL, {1});
+        const auto found = loaded.FindTopDocuments("parrot"s);
+        ASSERT_EQUAL(found.size(), 2u);
+        ASSERT_EQUAL(found[0].id, 1000);
+        ASSERT_EQUAL(found[1].id, 3);
+        ASSERT_EQUAL(std::get<0>(loaded.MatchDocument("fluffy parrot cat"s, 3)).size(), 2u);
+
+        // a snapshot of a loaded server is the same server again
+        loaded.SaveSnapshot(path);
+        const SearchServer reloaded = SearchServer::LoadSnapshot(path);
+        ASSERT_EQUAL(reloaded.GetDocumentCount(), loaded.GetDocumentCount());
+        ASSERT_EQUAL(reloaded.FindTopDocuments("parrot"s).size(), 2u);
+        ASSERT(ToMap(reloaded.GetWordFrequencies(3)) == ToMap(loaded.GetWordFrequencies(3)));
+    }
+
+    {
+        std::ofstream(path, std::ios::binary) << "SRCHSNAP"s;
+        bool is_thrown = false;
+        try {
+            SearchServer::LoadSnapshot(path);
+        } catch (const std::invalid_argument&) {
+            is_thrown = true;
+        }
+        ASSERT_HINT(is_thrown, "Truncated snapshot must be rejected"s);
+    }
+    {
+        // term count, table size, offsets of the term count + 1, table, characters
+        TermDictionary dictionary;
+        for (const std::string_view word : {"cat"sv, "dog"sv, "starling"sv}) {
+            dictionary.Intern(word);
+        }
+        SnapshotWriter writer(path);
+        dictionary.Save(writer);
+        writer.Finish();
+        std::ifstream input(path, std::ios::binary);
+        const std::string data((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+        const auto is_rejected = [&data](const size_t position, const auto value) {
+            std::string corrupted = data;
+            std::memcpy(corrupted.data() + position, &value, sizeof(value));
+            SnapshotReader reader(corrupted.data(), corrupted.size());
+            try {
+                TermDictionary::Map(reader);
+            } catch (const std::invalid_argument&) {
+                return true;
+            }
+            return false;
+        };
+        SnapshotReader reader(data.data(), data.size());
+        ASSERT_EQUAL(TermDictionary::Map(reader).GetTerm(2), "starling"sv);
+        const size_t offsets_position = 2 * sizeof(uint64_t);
+        const size_t table_position = offsets_position + 4 * sizeof(uint64_t);
+        ASSERT_HINT(is_rejected(offsets_position + sizeof(uint64_t), uint64_t{1} << 40), "Term offset out of the characters"s);
+        ASSERT_HINT(is_rejected(offsets_position + 2 * sizeof(uint64_t), uint64_t{1}), "Unsorted term offsets"s);
+        ASSERT_HINT(is_rejected(table_position, TermId{3}), "Table entry out of the terms"s);
+        ASSERT_HINT(is_rejected(table_position, TermId{-7}), "Negative table entry"s);
+    }
+    std::filesystem::remove(path);
+}
+
+void TestConcurrentSearchServer() {
+    ConcurrentSearchServer server("and"s);
+    for (int id = 0; id < 100; ++id) {
+        server.AddDocument(id, "white cat"s, DocumentStatus::ACTUAL, {1});
+    }
+
+    // a writer adds and removes documents in pairs inside one update,
+    // a reader must never see a generation with only a half of a pair
+    const int pair_count = 200;
+    std::atomic<bool> is_writing{true};
+    std::atomic<int> inconsistent_count{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; ++t) {
+        readers.emplace_back([&] {
+            while (is_writing.load()) {
+                server.Read([&](const SearchServer& search_server) {
+                    const auto found = search_server.FindTopDocuments("fluffy dog"s, DocumentStatus::ACTUAL, 1000);
+                    if (found.size() % 2 != 0 || search_server.GetDocumentCount() % 2 != 0) {
+                        ++inconsistent_count;
+                    }
+                });
+                const auto cats = server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, 1000);
+                if (cats.size() != 100) {
+                    ++inconsistent_count;
+                }
+            }
+        });
+    }
+
+    for (int i = 0; i < pair_count; ++i) {
+        const int id = 1000 + i * 2;
+        server.Update([id](SearchServer& search_server) {
+            search_server.AddDocument(id, "fluffy dog"s, DocumentStatus::ACTUAL, {2});
+            search_server.AddDocument(id + 1, "fluffy dog dog"s, DocumentStatus::ACTUAL, {3});
+        });
+        if (i % 3 == 0) {
+            server.Update([id](SearchServer& search_server) {
+                search_server.RemoveDocument(id);
+                search_server.RemoveDocument(id + 1);
+            });
+        }
+    }
+    is_writing.store(false);
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+
+    ASSERT_EQUAL_HINT(inconsistent_count.load(), 0, "Readers must see whole generations"s);
+    const int removed_pair_count = (pair_count + 2) / 3;
+    ASSERT_EQUAL(server.GetDocumentCount(), 100 + (pair_count - removed_pair_count) * 2);
+    ASSERT_EQUAL(server.GetGeneration(), static_cast<uint64_t>(100 + pair_count + removed_pair_count));
+    // both copies got every change
+    ASSERT_EQUAL(server.FindTopDocuments("dog"s, DocumentStatus::ACTUAL, 1000).size(), static_cast<size_t>(server.GetDocumentCount() - 100));
+    server.RemoveDocument(0);
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, 1000).size(), 99u);
+}
+
+void TestIndexSegments() {
+    SearchServer server("and"s);
+    const int document_count = SEGMENT_DOCUMENT_COUNT * SEGMENT_MERGE_FACTOR * 2 + 100;
+    for (int id = 0; id < document_count; ++id) {
+        server.AddDocument(id, id % 10 == 0 ? "rare fluffy cat"s : "common cat"s, DocumentStatus::ACTUAL, {id % 7});
+    }
+    server.WaitForMerges();
+    ASSERT_HINT(server.GetSegmentCount() <= static_cast<size_t>(SEGMENT_MERGE_FACTOR) + 1,
+                "Sealed segments must be merged, there are "s + std::to_string(server.GetSegmentCount()));
+
+    // IDF counts only live documents of every segment
+    for (int id = 0; id < document_count; id += 20) {
+        server.RemoveDocument(id);
+    }
+    const int live_count = document_count - (document_count + 19) / 20;
+    const int rare_count = (document_count + 9) / 10 - (document_count + 19) / 20;
+    const auto found = server.FindTopDocuments("rare"s, DocumentStatus::ACTUAL, document_count);
+    ASSERT_EQUAL(found.size(), static_cast<size_t>(rare_count));
+    ASSERT(std::abs(found[0].relevance - std::log(live_count * 1.0 / rare_count) / 3) < INACCURACY);
+    ASSERT_HINT(std::none_of(found.begin(), found.end(), [](const Document& document) { return document.id % 20 == 0; }),
+                "Removed documents must not be found"s);
+
+    const auto found_par = server.FindTopDocuments(std::execution::par, "fluffy cat -common"s, DocumentStatus::ACTUAL, document_count);
+    const auto found_pruned = server.FindTopDocumentsPruned("fluffy cat -common"s, DocumentStatus::ACTUAL, 10);
+    ASSERT_EQUAL(found_par.size(), static_cast<size_t>(rare_count));
+    for (size_t i = 0; i < found_pruned.size(); ++i) {
+        ASSERT_EQUAL(found_pruned[i].id, found_par[i].id);
+    }
+
+    // removed documents are dropped by the merges, a mostly removed segment is rewritten alone
+    const size_t posting_count = server.GetPostingCount();
+    for (int id = 0; id < SEGMENT_DOCUMENT_COUNT * 2; ++id) {
+        server.RemoveDocument(id);
+    }
+    server.AddDocument(document_count, "common cat"s, DocumentStatus::ACTUAL, {1});
+    server.WaitForMerges();
+    ASSERT_HINT(server.GetPostingCount() < posting_count, "Merge must drop the postings of removed documents"s);
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, document_count).size(),
+                 static_cast<size_t>(server.GetDocumentCount()));
+
+    // a segment keeps the lists of its own terms only: with every word in one document,
+    // the memory grows with the postings, not with the dictionary times the segments
+    SearchServer unique_words_server(""s);
+    const int unique_words_document_count = SEGMENT_DOCUMENT_COUNT * 3 + 10;
+    for (int id = 0; id < unique_words_document_count; ++id) {
+        std::string text;
+        for (int word = 0; word < 10; ++word) {
+            text += "w"s + std::to_string(id) + "_"s + std::to_string(word) + " "s;
+        }
+        unique_words_server.AddDocument(id, text, DocumentStatus::ACTUAL, {1});
+    }
+    unique_words_server.WaitForMerges();
+    ASSERT(unique_words_server.GetSegmentCount() >= 2u);
+    const size_t memory_usage = unique_words_server.GetPostingsMemoryUsage();
+    ASSERT_HINT(memory_usage < unique_words_server.GetPostingCount() * (sizeof(PostingList) + 128),
+                "Segments must not keep lists of absent terms, "s + std::to_string(memory_usage) + " bytes"s);
+}
+
+void TestAddDocuments() {
+    const std::vector<std::string> words = { "white"s, "cat"s, "fluffy"s, "tail"s, "dog"s, "eyes"s, "parrot"s, "and"s };
+    const int document_count = SEGMENT_DOCUMENT_COUNT * 2 + 10;
+    std::vector<std::string> texts;
+    for (int id = 0; id < document_count; ++id) {
+        std::string text;
+        for (int i = 0; i < 1 + id % 5; ++i) {
+            text += words[(id * 7 + i * 3) % words.size()] + " "s;
+        }
+        // repeated words, both new to the dictionary in the first documents and known in the rest
+        if (id % 4 == 0) {
+            text += words[id * 7 % words.size()];
+        }
+        texts.push_back(text);
+    }
+
+    SearchServer expected("and"s);
+    for (int id = 0; id < document_count; ++id) {
+        expected.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 3), {id % 11, 2});
+    }
+
+    // a small batch goes to the mutable segment, a large one to new sealed segments
+    SearchServer server("and"s);
+    std::vector<NewDocument> small_batch;
+    std::vector<NewDocument> large_batch;
+    for (int id = 0; id < document_count; ++id) {
+        (id < 10 ? small_batch : large_batch).push_back({id, texts[id], static_cast<DocumentStatus>(id % 3), {id % 11, 2}});
+    }
+    server.AddDocuments(small_batch);
+    server.AddDocuments(std::execution::par, large_batch);
+    ASSERT_EQUAL(server.GetDocumentCount(), document_count);
+    ASSERT(server.GetSegmentCount() >= 2u);
+
+    for (const std::string& query : { "cat"s, "fluffy parrot -dog"s, "white eyes tail"s }) {
+        for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT }) {
+            const auto expected_found = expected.FindTopDocuments(query, status, document_count);
+            const auto found = server.FindTopDocuments(query, status, document_count);
+            ASSERT_EQUAL(found.size(), expected_found.size());
+            for (size_t i = 0; i < found.size(); ++i) {
+                ASSERT_EQUAL(found[i].id, expected_found[i].id);
+                ASSERT(std::abs(found[i].relevance - expected_found[i].relevance) < INACCURACY);
+                ASSERT_EQUAL(found[i].rating, expected_found[i].rating);
+            }
+        }
+    }
+    ASSERT(ToMap(server.GetWordFrequencies(document_count - 1)) == ToMap(expected.GetWordFrequencies(document_count - 1)));
+    ASSERT(server.MatchDocument("fluffy cat dog"s, 42) == expected.MatchDocument("fluffy cat dog"s, 42));
+
+    // a bad batch changes nothing, the texts are literals as NewDocument only refers to them
+    const std::vector<std::vector<NewDocument>> bad_batches = {
+        { {document_count, "new cat", DocumentStatus::ACTUAL, {}}, {document_count, "another cat", DocumentStatus::ACTUAL, {}} },
+        { {document_count, "new cat", DocumentStatus::ACTUAL, {}}, {5, "existing cat", DocumentStatus::ACTUAL, {}} },
+        { {document_count, "new cat", DocumentStatus::ACTUAL, {}}, {-1, "negative cat", DocumentStatus::ACTUAL, {}} },
+        { {document_count, "new cat", DocumentStatus::ACTUAL, {}}, {document_count + 1, "special c\x12" "at", DocumentStatus::ACTUAL, {}} },
+    };
+    for (const auto& bad_batch : bad_batches) {
+        bool is_thrown = false;
+        try {
+            server.AddDocuments(std::execution::par, bad_batch);
+        } catch (const std::invalid_argument&) {
+            is_thrown = true;
+        }
+        ASSERT_HINT(is_thrown, "Invalid batch must be rejected"s);
+        ASSERT_EQUAL(server.GetDocumentCount(), document_count);
+        ASSERT(server.FindTopDocuments("new"s).empty());
+    }
+}
+
+void TestSplitIntoWords() {
+    std::vector<std::string_view> words = { "stale"sv };
+    ASSERT(SplitIntoWords(""sv, words) && words.empty());
+    ASSERT(SplitIntoWords("      "sv, words) && words.empty());
+    ASSERT(SplitIntoWords("  white  cat "sv, words));
+    ASSERT((words == std::vector<std::string_view>{ "white"sv, "cat"sv }));
+    ASSERT(SplitIntoWords("кот и -пёс"sv, words));
+    ASSERT((words == std::vector<std::string_view>{ "кот"sv, "и"sv, "-пёс"sv }));
+
+    // words across the block boundaries give the same result as a plain split
+    std::mt19937 generator(7);
+    for (int iteration = 0; iteration < 200; ++iteration) {
+        std::string text;
+        const int length = iteration;
+        for (int i = 0; i < length; ++i) {
+            text += generator() % 3 == 0 ? ' ' : static_cast<char>('a' + generator() % 26);
+        }
+        std::vector<std::string_view> expected;
+        for (size_t begin = 0; begin < text.size();) {
+            const size_t end = std::min(text.find(' ', begin), text.size());
+            if (end != begin) {
+                expected.push_back(std::string_view(text).substr(begin, end - begin));
+            }
+            begin = end + 1;
+        }
+        ASSERT(SplitIntoWords(text, words));
+        ASSERT_EQUAL_HINT(words.size(), expected.size(), text);
+        ASSERT_HINT(words == expected, text);
+
+        // a control char is found at any position, the words are still returned
+        if (!text.empty()) {
+            text[generator() % text.size()] = '\t';
+            ASSERT_HINT(!SplitIntoWords(text, words), text);
+        }
+    }
+    ASSERT(!SplitIntoWords(std::string(100, 'a') + "\x1f"s, words));
+    ASSERT_EQUAL(words.size(), 1u);
+}
+
+void TestQueryContext() {
+    // a COMPRESSED list decodes its blocks into the buffers of the cursor or the scan, not into the heap
+    for (const PostingFormat format : { PostingFormat::RAW, PostingFormat::COMPRESSED }) {
+        SearchServer server("and in"s, format);
+        server.AddDocument(1, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, {8, -3});
+        server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+        server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, {5, -12, 2, 1});
+        server.AddDocument(4, "groomed starling evgeny"s, DocumentStatus::BANNED, {9});
+        for (int id = 5; id < SEGMENT_DOCUMENT_COUNT + 100; ++id) {
+            server.AddDocument(id, id % 3 == 0 ? "fluffy dog"s : "white starling in the cat collar"s, DocumentStatus::ACTUAL, {id % 5});
+        }
+
+        QueryContext context;
+        for (const std::string& query : { "fluffy groomed cat"s, "white cat -dog"s, "starling and -collar"s, "cat cat -dog -dog"s, "absent"s }) {
+            const auto expected = server.FindTopDocuments(query);
+            const auto& found = server.FindTopDocuments(context, query);
+            ASSERT_EQUAL(found.size(), expected.size());
+            for (size_t i = 0; i < found.size(); ++i) {
+                ASSERT_EQUAL(found[i].id, expected[i].id);
+                ASSERT_EQUAL(found[i].relevance, expected[i].relevance);
+            }
+        }
+        ASSERT_EQUAL(server.FindTopDocuments(context, "groomed"s, DocumentStatus::BANNED).size(), 1u);
+        ASSERT_EQUAL(context.GetDocuments()[0].id, 4);
+
+        // the buffers are warm now, the same and smaller queries don't allocate
+        server.FindTopDocuments(context, "fluffy groomed cat -collar"s);
+        const std::string_view queries[] = { "fluffy groomed cat -collar", "white cat", "dog -starling" };
+        const size_t allocation_count_before = GetThreadAllocationCount();
+        size_t found_count = 0;
+        for (int i = 0; i < 10; ++i) {
+            for (const std::string_view query : queries) {
+                found_count += server.FindTopDocuments(context, query).size();
+            }
+        }
+        const size_t search_allocation_count = GetThreadAllocationCount() - allocation_count_before;
+        if (IS_ALLOCATION_COUNTED) {
+            ASSERT_EQUAL(search_allocation_count, 0u);
+        }
+        ASSERT(found_count > 0);
+
+        // nor does a prepared query
+        PreparedQuery prepared = server.Prepare(queries[0]);
+        server.FindTopDocuments(context, prepared);
+        const size_t prepared_allocation_count_before = GetThreadAllocationCount();
+        for (int i = 0; i < 10; ++i) {
+            server.FindTopDocuments(context, prepared);
+        }
+        const size_t prepared_allocation_count = GetThreadAllocationCount() - prepared_allocation_count_before;
+        if (IS_ALLOCATION_COUNTED) {
+            ASSERT_EQUAL(prepared_allocation_count, 0u);
+        }
+
+        // while a cold context does allocate, so the counter works
+        const size_t cold_allocation_count_before = GetThreadAllocationCount();
+        QueryContext cold_context;
+        server.FindTopDocuments(cold_context, "white cat"sv);
+        ASSERT(!IS_ALLOCATION_COUNTED || GetThreadAllocationCount() > cold_allocation_count_before);
+    }
+}
+
+void TestPreparedQuery() {
+    SearchServer server("and in"s);
+    server.AddDocument(1, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, {8, -3});
+    server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, {5, -12, 2, 1});
+
+    const auto check_prepared = [&server](PreparedQuery& prepared, const std::string& raw_query) {
+        const auto expected = server.FindTopDocuments(raw_query);
+        const auto found = server.FindTopDocuments(prepared);
+        ASSERT_EQUAL(found.size(), expected.size());
+        for (size_t i = 0; i < found.size(); ++i) {
+            ASSERT_EQUAL(found[i].id, expected[i].id);
+            ASSERT_EQUAL(found[i].relevance, expected[i].relevance);
+        }
+    };
+
+    // the text may go away, the prepared query keeps its words
+    std::string raw_query = "fluffy groomed cat -parrot starling"s;
+    PreparedQuery prepared = server.Prepare(raw_query);
+    const std::string saved_query = raw_query;
+    raw_query.assign(raw_query.size(), 'x');
+    ASSERT_EQUAL(prepared.GetIndexVersion(), server.GetIndexVersion());
+    check_prepared(prepared, saved_query);
+
+    // new documents change IDF and add words which were unknown when the query was prepared
+    const uint64_t version = server.GetIndexVersion();
+    server.AddDocument(4, "groomed starling evgeny"s, DocumentStatus::ACTUAL, {9});
+    server.AddDocument(5, "parrot and cat"s, DocumentStatus::ACTUAL, {1});
+    ASSERT(server.GetIndexVersion() != version);
+    check_prepared(prepared, saved_query);
+    ASSERT_EQUAL(prepared.GetIndexVersion(), server.GetIndexVersion());
+
+    server.RemoveDocument(2);
+    check_prepared(prepared, saved_query);
+
+    // a query of another server is never taken as valid
+    SearchServer other("and in"s);
+    other.AddDocument(1, "fluffy cat"s, DocumentStatus::ACTUAL, {1});
+    QueryContext context;
+    ASSERT_EQUAL(other.FindTopDocuments(context, prepared).size(), 1u);
+    ASSERT_EQUAL(other.FindTopDocuments(context, prepared, DocumentStatus::BANNED).size(), 0u);
+
+    bool is_thrown = false;
+    try {
+        server.Prepare("cat --dog"s);
+    } catch (const std::invalid_argument&) {
+        is_thrown = true;
+    }
+    ASSERT_HINT(is_thrown, "Invalid query must be rejected by Prepare"s);
+}
+
+void TestResultCache() {
+    SearchServer server("and in"s);
+    server.AddDocument(1, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, {8, -3});
+    server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::BANNED, {5, -12, 2, 1});
+
+    ResultCache cache(server, RESULT_CACHE_SHARD_COUNT * 2);
+    const auto check_cached = [&](const std::string& raw_query, DocumentStatus status) {
+        const auto expected = server.FindTopDocuments(raw_query, status);
+        const auto found = cache.FindTopDocuments(raw_query, status);
+        ASSERT_EQUAL(found.size(), expected.size());
+        for (size_t i = 0; i < found.size(); ++i) {
+            ASSERT_EQUAL(found[i].id, expected[i].id);
+            ASSERT_EQUAL(found[i].relevance, expected[i].relevance);
+        }
+    };
+
+    // the order of the words, repeated words and stop words don't change the key
+    check_cached("fluffy cat -dog"s, DocumentStatus::ACTUAL);
+    check_cached("-dog cat and fluffy cat"s, DocumentStatus::ACTUAL);
+    ASSERT_EQUAL(cache.GetMissCount(), 1u);
+    ASSERT_EQUAL(cache.GetHitCount(), 1u);
+    check_cached("fluffy cat -dog"s, DocumentStatus::BANNED);
+    check_cached("groomed"s, DocumentStatus::BANNED);
+    ASSERT_EQUAL(cache.GetMissCount(), 3u);
+
+    // words missing in the index are in the key too, a hit neither resolves the query nor allocates
+    check_cached("parrot cat"s, DocumentStatus::BANNED);
+    const std::string hit_query = "cat parrot and"s;
+    ASSERT(cache.FindTopDocuments(hit_query, DocumentStatus::BANNED).empty());
+    const size_t allocation_count_before = GetThreadAllocationCount();
+    const size_t hit_document_count = cache.FindTopDocuments(hit_query, DocumentStatus::BANNED).size();
+    const size_t hit_allocation_count = GetThreadAllocationCount() - allocation_count_before;
+    ASSERT_EQUAL(hit_document_count, 0u);
+    if (IS_ALLOCATION_COUNTED) {
+        ASSERT_EQUAL(hit_allocation_count, 0u);
+    }
+    ASSERT_EQUAL(cache.GetMissCount(), 4u);
+    ASSERT_EQUAL(cache.GetHitCount(), 3u);
+    bool is_thrown = false;
+    try {
+        cache.FindTopDocuments("cat --dog"s);
+    } catch (const std::invalid_argument&) {
+        is_thrown = true;
+    }
+    ASSERT(is_thrown);
+    server.AddDocument(5, "parrot"s, DocumentStatus::BANNED, {1});
+    ASSERT_EQUAL(cache.FindTopDocuments("cat parrot"s, DocumentStatus::BANNED).size(), 1u);
+
+    // a change of the index outdates the entries
+    server.AddDocument(4, "fluffy groomed starling"s, DocumentStatus::ACTUAL, {9});
+    check_cached("cat fluffy -dog"s, DocumentStatus::ACTUAL);
+    ASSERT_EQUAL(cache.GetMissCount(), 6u);
+    check_cached("cat fluffy -dog"s, DocumentStatus::ACTUAL);
+    ASSERT_EQUAL(cache.GetHitCount(), 4u);
+    server.RemoveDocument(2);
+    check_cached("cat fluffy -dog"s, DocumentStatus::ACTUAL);
+    ASSERT_EQUAL(cache.GetMissCount(), 7u);
+
+    // the least recently used entries are evicted
+    for (int i = 0; i < 200; ++i) {
+        cache.FindTopDocuments("cat word"s + std::to_string(i));
+    }
+    ASSERT(cache.size() <= RESULT_CACHE_SHARD_COUNT * 2);
+
+    // concurrent searches see the same results, every search is a hit or a miss
+    const uint64_t search_count_before = cache.GetHitCount() + cache.GetMissCount();
+    const std::vector<std::string> queries = { "fluffy cat"s, "white collar"s, "groomed -cat"s, "eyes"s };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&cache, &queries] {
+            for (int i = 0; i < 100; ++i) {
+                cache.FindTopDocuments(queries[i % queries.size()]);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQUAL(cache.GetHitCount() + cache.GetMissCount() - search_count_before, 400u);
+    ASSERT(cache.GetHitCount() >= 4u + 400u - 4u * 4u);
+}
+
+void TestTermStatistics() {
+    TermStatistics statistics;
+    statistics.Resize(3);
+    statistics.AddDocuments(0, 2, 0.5);
+    statistics.AddDocuments(2, 1, 0.25);
+    statistics.AddDocuments(0, 1, 0.75);
+    ASSERT_EQUAL(statistics.GetDocumentFreq(0), 3);
+    ASSERT_EQUAL(statistics.GetDocumentFreq(1), 0);
+    ASSERT_EQUAL(statistics.GetMaxTermFreq(0), 0.75);
+    // the same bits as the formula of the relevance, so equal relevances stay equal
+    ASSERT_EQUAL(statistics.GetInverseDocumentFreq(0, 4), std::log(4 * 1.0 / 3));
+    ASSERT_EQUAL(statistics.GetInverseDocumentFreq(2, 4), std::log(4 * 1.0 / 1));
+
+    // a new document count or a changed frequency is seen at once
+    ASSERT_EQUAL(statistics.GetInverseDocumentFreq(0, 6), std::log(6 * 1.0 / 3));
+    statistics.RemoveDocument(0);
+    ASSERT_EQUAL(statistics.GetInverseDocumentFreq(0, 6), std::log(6 * 1.0 / 2));
+    ASSERT_EQUAL(statistics.GetMaxTermFreq(0), 0.75);
+    // a term added after the table was computed
+    statistics.Resize(4);
+    statistics.AddDocuments(3, 2, 0.5);
+    ASSERT_EQUAL(statistics.GetInverseDocumentFreq(3, 6), std::log(6 * 1.0 / 2));
+    ASSERT_EQUAL(statistics.GetInverseDocumentFreq(3, 7), std::log(7 * 1.0 / 2));
+
+    // removed documents leave neither document frequency nor IDF behind
+    SearchServer server("and"s);
+    server.AddDocument(1, "white cat and collar"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "fluffy cat"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(3, "groomed dog"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(4, "only and"s, DocumentStatus::ACTUAL, {1});
+    ASSERT(std::abs(server.FindTopDocuments("cat"s)[0].relevance - std::log(4.0 / 2) / 2) < INACCURACY);
+    server.RemoveDocument(std::execution::par, 2);
+    ASSERT(std::abs(server.FindTopDocuments("cat"s)[0].relevance - std::log(3.0 / 1) / 3) < INACCURACY);
+    server.RemoveDocument(1);
+    ASSERT(server.FindTopDocuments("cat"s).empty());
+    server.AddDocument(5, "cat"s, DocumentStatus::ACTUAL, {1});
+    ASSERT(std::abs(server.FindTopDocuments("cat"s)[0].relevance - std::log(3.0 / 1)) < INACCURACY);
+}
+
+void TestForwardIndex() {
+    ForwardIndex index;
+    index.AddDocument(std::vector<std::pair<TermId, double>>{{1, 0.5}, {4, 0.25}, {7, 0.25}});
+    index.AddDocument(std::vector<std::pair<TermId, double>>{});
+    index.AddDocument(std::vector<std::pair<TermId, double>>{{2, 1.0}});
+    ASSERT_EQUAL(index.GetDocumentCount(), 3u);
+    const DocumentWords words = index.GetWords(0);
+    ASSERT_EQUAL(words.size(), 3u);
+    ASSERT_EQUAL(words.GetTermId(1), 4);
+    ASSERT_EQUAL(words.GetTermFreq(1), 0.25);
+    ASSERT(words.Contains(7) && !words.Contains(2));
+    ASSERT_EQUAL(index.GetWords(1).size(), 0u);
+    ASSERT_EQUAL(index.GetWords(2).GetTermId(0), 2);
+
+    SearchServer server("and with"s);
+    server.AddDocument(1, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, {8});
+    server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {7});
+    server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, {5});
+
+    // the view reads the index in place
+    const size_t allocation_count_before = GetThreadAllocationCount();
+    const WordFrequencies word_frequencies = server.GetWordFrequencies(2);
+    double freq_sum = 0;
+    for (const auto& [word, freq] : word_frequencies) {
+        freq_sum += word == "fluffy"sv ? freq : 0;
+    }
+    const size_t view_allocation_count = GetThreadAllocationCount() - allocation_count_before;
+    if (IS_ALLOCATION_COUNTED) {
+        ASSERT_EQUAL(view_allocation_count, 0u);
+    }
+    ASSERT_EQUAL(word_frequencies.size(), 3u);
+    ASSERT_EQUAL(freq_sum, 0.5);
+    ASSERT(server.GetWordFrequencies(42).empty());
+
+    const std::vector<std::string_view> expected_words = {"cat"sv, "fluffy"sv};
+    ASSERT(std::get<0>(server.MatchDocument("tail -collar fluffy cat"s, 2)) == (std::vector<std::string_view>{"cat"sv, "fluffy"sv, "tail"sv}));
+    ASSERT(std::get<0>(server.MatchDocument(std::execution::par, "fluffy cat dog"s, 2)) == expected_words);
+    ASSERT(std::get<0>(server.MatchDocument("fluffy cat -tail"s, 2)).empty());
+
+    // a removed document keeps its words in the arena until the snapshot, but not in the view
+    server.RemoveDocument(2);
+    ASSERT(server.GetWordFrequencies(2).empty());
+    ASSERT(server.GetForwardIndexMemoryUsage() > 0u);
+
+    const std::string path = (std::filesystem::temp_directory_path() / "forward_index_test.snap"s).string();
+    server.SaveSnapshot(path);
+    {
+        SearchServer loaded = SearchServer::LoadSnapshot(path);
+        ASSERT(ToMap(loaded.GetWordFrequencies(1)) == ToMap(server.GetWordFrequencies(1)));
+        ASSERT(loaded.GetWordFrequencies(2).empty());
+        loaded.AddDocument(4, "fluffy dog"s, DocumentStatus::ACTUAL, {1});
+        ASSERT_EQUAL(loaded.GetWordFrequencies(4).size(), 2u);
+        ASSERT(std::get<0>(loaded.MatchDocument("dog eyes"s, 3)) == (std::vector<std::string_view>{"dog"sv, "eyes"sv}));
+    }
+    std::filesystem::remove(path);
+}
+
+void TestRemoveDuplicates() {
+    const auto make_server = [] {
+        SearchServer server("and with"s);
+        server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, {7, 2, 7});
+        server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+        // the same words as 2, in another order and repeated
+        server.AddDocument(3, "curly hair funny pet pet"s, DocumentStatus::ACTUAL, {1, 2});
+        server.AddDocument(4, "funny pet and curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+        server.AddDocument(5, "a b c d e f g h i"s, DocumentStatus::ACTUAL, {1});
+        // 9 of the 10 words of 5
+        server.AddDocument(6, "a b c d e f g h i j"s, DocumentStatus::ACTUAL, {1});
+        server.AddDocument(7, "and with"s, DocumentStatus::ACTUAL, {1});
+        server.AddDocument(8, "with"s, DocumentStatus::ACTUAL, {1});
+        server.AddDocument(9, "a b c x y z"s, DocumentStatus::ACTUAL, {1});
+        return server;
+    };
+
+    {
+        SearchServer server = make_server();
+        const std::vector<DuplicateDocument> duplicates = RemoveDuplicates(server);
+        ASSERT_EQUAL(duplicates.size(), 3u);
+        ASSERT(duplicates[0].id == 3 && duplicates[0].original_id == 2 && duplicates[0].similarity == 1);
+        ASSERT(duplicates[1].id == 4 && duplicates[1].original_id == 2);
+        ASSERT_HINT(duplicates[2].id == 8 && duplicates[2].original_id == 7, "Documents of stop words only are duplicates"s);
+        ASSERT_EQUAL(server.GetDocumentCount(), 6);
+        ASSERT(server.FindTopDocuments("curly"s).size() == 1u && server.FindTopDocuments("curly"s)[0].id == 2);
+        ASSERT(RemoveDuplicates(server).empty());
+    }
+    {
+        SearchServer server = make_server();
+        DeduplicationOptions options;
+        options.near_duplicates = true;
+        options.jaccard_threshold = 0.85;
+        const std::vector<DuplicateDocument> duplicates = RemoveDuplicates(server, options);
+        ASSERT_EQUAL(duplicates.size(), 4u);
+        ASSERT(duplicates[2].id == 6 && duplicates[2].original_id == 5);
+        ASSERT(std::abs(duplicates[2].similarity - 0.9) < INACCURACY);
+        ASSERT_EQUAL(server.GetDocumentCount(), 5);
+        ASSERT_EQUAL(server.FindTopDocuments("x"s).size(), 1u);
+    }
+    {
+        SearchServer server = make_server();
+        DeduplicationOptions options;
+        options.near_duplicates = true;
+        options.minhash_count = 10;
+        options.band_count = 3;
+        bool is_thrown = false;
+        try {
+            RemoveDuplicates(server, options);
+        } catch (const std::invalid_argument&) {
+            is_thrown = true;
+        }
+        ASSERT_HINT(is_thrown && server.GetDocumentCount() == 9, "Bad options must be rejected before removing anything"s);
+    }
+
+    // a larger batch: every document has an exact copy and a copy with one word replaced
+    SearchServer server(""s);
+    std::mt19937 generator(7);
+    std::uniform_int_distribution<int> word_distribution(0, 5000);
+    for (int id = 0; id < 300; id += 3) {
+        std::vector<std::string> words;
+        for (int i = 0; i < 40; ++i) {
+            words.push_back("w"s + std::to_string(word_distribution(generator)));
+        }
+        std::string text;
+        for (const std::string& word : words) {
+            text += word + " "s;
+        }
+        server.AddDocument(id, text, DocumentStatus::ACTUAL, {1});
+        server.AddDocument(id + 1, text, DocumentStatus::ACTUAL, {1});
+        server.AddDocument(id + 2, text + "unique"s + std::to_string(id), DocumentStatus::ACTUAL, {1});
+    }
+    DeduplicationOptions options;
+    options.near_duplicates = true;
+    options.jaccard_threshold = 0.9;
+    const std::vector<DuplicateDocument> duplicates = RemoveDuplicates(server, options);
+    ASSERT_EQUAL(duplicates.size(), 200u);
+    for (const DuplicateDocument& duplicate : duplicates) {
+        ASSERT_EQUAL(duplicate.original_id, duplicate.id / 3 * 3);
+    }
+    ASSERT_EQUAL(server.GetDocumentCount(), 100);
+}
+
+void TestRemoveDocuments() {
+    const auto make_server = [](const int document_count) {
+        SearchServer server("and"s);
+        for (int id = 0; id < document_count; ++id) {
+            const std::string text = "common word"s + std::to_string(id % 10) + " unique"s + std::to_string(id);
+            server.AddDocument(id, text, DocumentStatus::ACTUAL, {id % 7});
+        }
+        return server;
+    };
+    const int document_count = SEGMENT_DOCUMENT_COUNT * 3 + 100;
+    SearchServer server = make_server(document_count);
+    SearchServer expected = make_server(document_count);
+    server.WaitForMerges();
+
+    // every third document, an unknown id and a repeated one
+    std::vector<int> removed_ids = {-5, document_count + 1, 3};
+    for (int id = 0; id < document_count; id += 3) {
+        removed_ids.push_back(id);
+        expected.RemoveDocument(id);
+    }
+    const uint64_t version = server.GetIndexVersion();
+    server.RemoveDocuments(std::execution::par, removed_ids);
+    ASSERT(server.GetIndexVersion() != version);
+    ASSERT_EQUAL(server.GetDocumentCount(), expected.GetDocumentCount());
+    ASSERT(server.FindTopDocuments("unique3"s).empty());
+    ASSERT(std::vector<int>(server.begin(), server.end()) == std::vector<int>(expected.begin(), expected.end()));
+
+    const auto assert_same_results = [&expected](const SearchServer& server) {
+        for (const std::string& query : {"common"s, "word3 word4 -unique4"s, "unique7 word1"s, "unique9"s, "unique3000 word5"s}) {
+            const auto found = server.FindTopDocuments(query);
+            const auto expected_found = expected.FindTopDocuments(query);
+            ASSERT_EQUAL_HINT(found.size(), expected_found.size(), query);
+            for (size_t i = 0; i < found.size(); ++i) {
+                ASSERT_EQUAL_HINT(found[i].id, expected_found[i].id, query);
+                ASSERT_HINT(std::abs(found[i].relevance - expected_found[i].relevance) < INACCURACY, query);
+            }
+        }
+    };
+    assert_same_results(server);
+
+    // the terms of the removed documents only are dropped, the rest keep their words
+    const size_t posting_count = server.GetPostingCount();
+    const uint64_t compacted_version = server.GetIndexVersion();
+    server.Compact();
+    ASSERT(server.GetIndexVersion() != compacted_version);
+    ASSERT(server.GetPostingCount() < posting_count);
+    ASSERT_EQUAL(server.GetPostingCount(), static_cast<size_t>(server.GetDocumentCount()) * 3);
+    assert_same_results(server);
+    ASSERT(ToMap(server.GetWordFrequencies(4)) == ToMap(expected.GetWordFrequencies(4)));
+    ASSERT(std::get<0>(server.MatchDocument("unique4 common -unique3"s, 4)) == (std::vector<std::string_view>{"common"sv, "unique4"sv}));
+
+    // the compacted server stays writable, a removed word may come back with a new id
+    server.AddDocument(document_count, "unique3 common"s, DocumentStatus::ACTUAL, {1});
+    expected.AddDocument(document_count, "unique3 common"s, DocumentStatus::ACTUAL, {1});
+    server.RemoveDocuments({1, 2});
+    expected.RemoveDocument(1);
+    expected.RemoveDocument(2);
+    assert_same_results(server);
+    ASSERT_EQUAL(server.FindTopDocuments("unique3"s).size(), 1u);
+
+    const std::string path = (std::filesystem::temp_directory_path() / "remove_documents_test.snap"s).string();
+    server.SaveSnapshot(path);
+    {
+        SearchServer loaded = SearchServer::LoadSnapshot(path);
+        loaded.RemoveDocuments(std::execution::seq, {4, 5});
+        loaded.Compact();
+        ASSERT_EQUAL(loaded.GetDocumentCount(), expected.GetDocumentCount() - 2);
+        ASSERT(loaded.FindTopDocuments("unique4"s).empty());
+        ASSERT_EQUAL(loaded.FindTopDocuments("unique7"s).size(), 1u);
+    }
+    std::filesystem::remove(path);
+}
+
+void TestDocumentAttributes() {
+    DocumentAttributes attributes;
+    for (int i = 0; i < 130; ++i) {
+        attributes.Add(i * 10, i % 5, i % 3 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL);
+    }
+    attributes.Remove(129);
+    ASSERT_EQUAL(attributes.size(), 130u);
+    ASSERT_EQUAL(attributes.GetId(129), 1290);
+    ASSERT_EQUAL(attributes.GetRating(129), 4);
+    ASSERT(attributes.GetStatus(129) == DocumentStatus::BANNED);
+    ASSERT(DocumentAttributes::TestBit(attributes.GetStatusBitmap(DocumentStatus::BANNED), 126));
+    ASSERT(!DocumentAttributes::TestBit(attributes.GetStatusBitmap(DocumentStatus::BANNED), 129));
+    ASSERT(!DocumentAttributes::TestBit(attributes.GetStatusBitmap(DocumentStatus::ACTUAL), 126));
+    ASSERT(DocumentAttributes::TestBit(attributes.GetStatusBitmap(DocumentStatus::ACTUAL), 128));
+
+    // the status overloads go through the bitmaps and must agree with the same predicate
+    const auto make_server = [](PostingFormat format) {
+        SearchServer server("and"s, format);
+        for (int id = 0; id < SEGMENT_DOCUMENT_COUNT + 300; ++id) {
+            const DocumentStatus status = static_cast<DocumentStatus>(id % 4);
+            server.AddDocument(id, "cat word"s + std::to_string(id % 13) + (id % 2 == 0 ? " dog"s : " collar"s), status, {id % 11});
+        }
+        return server;
+    };
+    for (const PostingFormat format : {PostingFormat::RAW, PostingFormat::COMPRESSED}) {
+        SearchServer server = make_server(format);
+        server.RemoveDocuments({0, 1, 2, 3, 400, 401});
+        const auto assert_same_results = [&server](const std::string& query, const DocumentStatus status) {
+            const auto by_status = [status](int, DocumentStatus document_status, int) {
+                return document_status == status;
+            };
+            const auto expected = server.FindTopDocuments(query, by_status, 1000);
+            const std::vector<std::vector<Document>> results = {
+                server.FindTopDocuments(query, status, 1000),
+                server.FindTopDocuments(std::execution::par, query, status, 1000),
+                server.FindTopDocumentsPruned(query, status, 1000),
+            };
+            for (const std::vector<Document>& found : results) {
+                ASSERT_EQUAL_HINT(found.size(), expected.size(), query);
+                for (size_t i = 0; i < found.size(); ++i) {
+                    ASSERT_EQUAL_HINT(found[i].id, expected[i].id, query);
+                    ASSERT_EQUAL_HINT(found[i].rating, expected[i].rating, query);
+                    ASSERT_HINT(std::abs(found[i].relevance - expected[i].relevance) < INACCURACY, query);
+                }
+            }
+            QueryContext context;
+            ASSERT_EQUAL_HINT(server.FindTopDocuments(context, query, status, 1000).size(), expected.size(), query);
+        };
+        for (const std::string& query : {"cat"s, "dog word4"s, "word5 -collar"s}) {
+            for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT,
+                                                DocumentStatus::BANNED, DocumentStatus::REMOVED}) {
+                assert_same_results(query, status);
+            }
+        }
+        ASSERT(server.FindTopDocuments("word0"s, DocumentStatus::ACTUAL, 1000).size()
+               == server.FindTopDocuments("word0"s, [](int id, DocumentStatus, int) { return id % 4 == 0; }, 1000).size());
+
+        // the bitmaps are rebuilt from a snapshot without the removed documents
+        const std::string path = (std::filesystem::temp_directory_path() / "document_attributes_test.snap"s).string();
+        server.SaveSnapshot(path);
+        const SearchServer loaded = SearchServer::LoadSnapshot(path);
+        for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::BANNED}) {
+            const auto found = loaded.FindTopDocuments("cat"s, status, 2000);
+            ASSERT_EQUAL(found.size(), server.FindTopDocuments("cat"s, status, 2000).size());
+            ASSERT(std::none_of(found.begin(), found.end(), [](const Document& document) {
+                return document.id == 0 || document.id == 400;
+            }));
+        }
+        std::filesystem::remove(path);
+    }
+}
+
+void TestQueryExecutor() {
+    {
+        QueryExecutor executor(3);
+        ASSERT_EQUAL(executor.GetThreadCount(), 3u);
+        std::vector<int> calls(1000, 0);
+        executor.ParallelFor(calls.size(), [&calls](const size_t i) {
+            ++calls[i];
+        });
+        ASSERT(std::all_of(calls.begin(), calls.end(), [](const int count) { return count == 1; }));
+
+        // nested calls from the tasks of the pool finish even when every thread is busy
+        std::atomic<int> inner_count{0};
+        executor.ParallelFor(8, [&](size_t) {
+            executor.ParallelFor(50, [&](size_t) {
+                ++inner_count;
+            });
+        });
+        ASSERT_EQUAL(inner_count.load(), 400);
+
+        bool is_thrown = false;
+        try {
+            executor.ParallelFor(10, [](const size_t i) {
+                if (i == 7) {
+                    throw std::out_of_range("seven"s);
+                }
+            });
+        } catch (const std::out_of_range&) {
+            is_thrown = true;
+        }
+        ASSERT(is_thrown);
+
+        std::promise<int> promise;
+        executor.Submit([&promise] {
+            promise.set_value(42);
+        });
+        ASSERT_EQUAL(promise.get_future().get(), 42);
+    }
+
+    SearchServer server("and with"s);
+    for (int id = 0; id < SEGMENT_DOCUMENT_COUNT * 2 + 50; ++id) {
+        server.AddDocument(id, "word"s + std::to_string(id % 31) + " word"s + std::to_string(id % 17) + " text"s + std::to_string(id % 7),
+                           static_cast<DocumentStatus>(id % 2), {id % 9});
+    }
+    std::vector<std::string> queries = {"word1 text3"s, "word5 -text2"s, ""s, "nothing"s};
+    std::string long_query;
+    for (int i = 0; i < 40; ++i) {
+        long_query += "word"s + std::to_string(i) + (i % 10 == 0 ? " -text"s + std::to_string(i % 7) + " "s : " "s);
+    }
+    queries.push_back(long_query);
+    QueryExecutor executor(2);
+    QueryLatencies latencies;
+    const auto results = ProcessQueries(executor, server, queries, &latencies);
+    ASSERT_EQUAL(results.size(), queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const auto expected = server.FindTopDocuments(queries[i]);
+        ASSERT_EQUAL_HINT(results[i].size(), expected.size(), queries[i]);
+        for (size_t j = 0; j < expected.size(); ++j) {
+            ASSERT_EQUAL_HINT(results[i][j].id, expected[j].id, queries[i]);
+            ASSERT_HINT(std::abs(results[i][j].relevance - expected[j].relevance) < INACCURACY, queries[i]);
+        }
+    }
+    ASSERT(!results.back().empty());
+    ASSERT(latencies.p50 <= latencies.p90 && latencies.p90 <= latencies.p99 && latencies.p99 <= latencies.max);
+    ASSERT(latencies.max.count() > 0);
+
+    const auto predicate = [](int id, DocumentStatus, int) { return id % 3 == 0; };
+    const auto found = server.FindTopDocuments(executor, long_query, predicate, 20);
+    const auto expected = server.FindTopDocuments(long_query, predicate, 20);
+    ASSERT_EQUAL(found.size(), expected.size());
+    for (size_t i = 0; i < found.size(); ++i) {
+        ASSERT_EQUAL(found[i].id, expected[i].id);
+    }
+
+    const JoinedResults joined = ProcessQueriesJoined(executor, server, queries);
+    size_t result_count = 0;
+    for (const auto& documents : results) {
+        result_count += documents.size();
+    }
+    ASSERT_EQUAL(joined.size(), result_count);
+    ASSERT_EQUAL(joined.begin()->id, results[0][0].id);
+}
+
+void TestProcessQueriesStreamed() {
+    SearchServer server("and with"s);
+    for (int id = 0; id < 500; ++id) {
+        server.AddDocument(id, "word"s + std::to_string(id % 31) + " text"s + std::to_string(id % 7), DocumentStatus::ACTUAL, {id % 9});
+    }
+    // more queries than the window holds
+    std::vector<std::string> queries;
+    for (size_t i = 0; i < STREAMED_QUERY_WINDOW_SIZE * 3 + 7; ++i) {
+        queries.push_back("word"s + std::to_string(i % 37) + " text"s + std::to_string(i % 5));
+    }
+    QueryExecutor executor(3);
+    const auto expected = ProcessQueries(executor, server, queries);
+
+    std::vector<size_t> emitted;
+    ProcessQueriesStreamed(executor, server, queries, [&](const size_t query_index, const std::vector<Document>& documents) {
+        emitted.push_back(query_index);
+        ASSERT_EQUAL(documents.size(), expected[query_index].size());
+        for (size_t i = 0; i < documents.size(); ++i) {
+            ASSERT_EQUAL(documents[i].id, expected[query_index][i].id);
+        }
+    });
+    ASSERT_EQUAL(emitted.size(), queries.size());
+    ASSERT_HINT(std::is_sorted(emitted.begin(), emitted.end()), "Results must come in query order"s);
+
+    QueryLatencies latencies;
+    const JoinedResults joined = ProcessQueriesJoined(executor, server, queries, &latencies);
+    ASSERT_EQUAL(joined.GetQueryCount(), queries.size());
+    ASSERT(latencies.max.count() > 0);
+    size_t result_count = 0;
+    for (size_t query_index = 0; query_index < queries.size(); ++query_index) {
+        const auto query_results = joined.GetQueryResults(query_index);
+        ASSERT_EQUAL(query_results.size(), expected[query_index].size());
+        ASSERT(std::equal(query_results.begin(), query_results.end(), expected[query_index].begin(),
+                          [](const Document& lhs, const Document& rhs) { return lhs.id == rhs.id; }));
+        result_count += query_results.size();
+    }
+    ASSERT_EQUAL(joined.size(), result_count);
+
+    // a bad query stops the batch, the results before it are already passed on
+    queries[300] = "text1 --word2"s;
+    size_t emitted_count = 0;
+    bool is_thrown = false;
+    try {
+        ProcessQueriesStreamed(executor, server, queries, [&emitted_count](size_t, const std::vector<Document>&) {
+            ++emitted_count;
+        });
+    } catch (const std::invalid_argument&) {
+        is_thrown = true;
+    }
+    ASSERT(is_thrown);
+    ASSERT(emitted_count <= 300u);
+    ASSERT(ProcessQueriesJoined(executor, server, {}).empty());
+}
+
+void TestFindTopDocumentsAsync() {
+    SearchServer server("and with"s);
+    const int document_count = STOP_CHECK_INTERVAL + SEGMENT_DOCUMENT_COUNT + 100;
+    std::vector<std::string> texts;
+    for (int id = 0; id < document_count; ++id) {
+        texts.push_back("cat word"s + std::to_string(id % 97) + (id % 3 == 0 ? " dog"s : ""s));
+    }
+    std::vector<NewDocument> documents;
+    for (int id = 0; id < document_count; ++id) {
+        documents.push_back({id, texts[id], static_cast<DocumentStatus>(id % 2), {id % 50}});
+    }
+    server.AddDocuments(documents);
+    QueryExecutor executor(2);
+
+    const SearchResult result = server.FindTopDocumentsAsync(executor, "cat word7 -dog"s, StopToken(), DocumentStatus::ACTUAL, 10).get();
+    const auto expected = server.FindTopDocuments("cat word7 -dog"s, DocumentStatus::ACTUAL, 10);
+    ASSERT(!result.is_truncated);
+    ASSERT_EQUAL(result.documents.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        ASSERT_EQUAL(result.documents[i].id, expected[i].id);
+        ASSERT_EQUAL(result.documents[i].relevance, expected[i].relevance);
+    }
+    const SearchResult result_in_time = server.FindTopDocumentsAsync("cat word7 -dog"s,
+                                                                     StopToken::Clock::now() + std::chrono::hours(1), DocumentStatus::ACTUAL, 10).get();
+    ASSERT(!result_in_time.is_truncated && result_in_time.documents.size() == expected.size());
+
+    // a search past its deadline or cancelled before it starts returns nothing
+    ASSERT(server.FindTopDocumentsAsync("cat"s, StopToken::Clock::now() - std::chrono::seconds(1)).get().is_truncated);
+    const StopToken cancelled;
+    cancelled.Cancel();
+    const SearchResult cancelled_result = server.FindTopDocumentsAsync(executor, "cat"s, cancelled).get();
+    ASSERT(cancelled_result.is_truncated && cancelled_result.documents.empty());
+
+    // cancelled while scanning: the scanned range is finished, the rest is skipped
+    const StopToken stop_token;
+    const auto cancelling_predicate = [stop_token](int document_id, DocumentStatus, int) {
+        if (document_id == 3) {
+            stop_token.Cancel();
+        }
+        return true;
+    };
+    const SearchResult partial = server.FindTopDocumentsAsync(executor, "word5 dog"s, stop_token, cancelling_predicate, document_count).get();
+    ASSERT(partial.is_truncated);
+    const auto all_found = server.FindTopDocuments("word5 dog"s, [](int, DocumentStatus, int) { return true; }, document_count);
+    ASSERT(!partial.documents.empty() && partial.documents.size() < all_found.size());
+    for (const Document& document : partial.documents) {
+        ASSERT(document.id < STOP_CHECK_INTERVAL);
+        const auto found = std::find_if(all_found.begin(), all_found.end(), [&document](const Document& other) {
+            return other.id == document.id;
+        });
+        ASSERT(found != all_found.end() && found->relevance == document.relevance);
+    }
+
+    bool is_thrown = false;
+    try {
+        server.FindTopDocumentsAsync(executor, "cat --dog"s, StopToken()).get();
+    } catch (const std::invalid_argument&) {
+        is_thrown = true;
+    }
+    ASSERT(is_thrown);
+}
+
+void TestRequestQueue() {
+    for (const int64_t value : std::vector<int64_t>{0, 1, 7, 8, 9, 15, 16, 17, 1000, 123456789, 68000000000}) {
+        const std::chrono::nanoseconds latency(value);
+        const size_t bucket = GetLatencyBucket(latency);
+        ASSERT(bucket < LATENCY_BUCKET_COUNT);
+        ASSERT(GetLatencyBucketBound(bucket) <= latency);
+        ASSERT(bucket + 1 == LATENCY_BUCKET_COUNT || latency < GetLatencyBucketBound(bucket + 1));
+    }
+
+    SearchServer server("and with"s);
+    server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    server.AddDocument(2, "curly dog and fancy collar"s, DocumentStatus::BANNED, {1, 2, 3});
+    {
+        RequestQueue request_queue(server);
+        ASSERT_EQUAL(request_queue.AddFindRequest("curly"s).size(), 1u);
+        ASSERT_EQUAL(request_queue.AddFindRequest("curly"s, DocumentStatus::BANNED).size(), 1u);
+        ASSERT(request_queue.AddFindRequest("sparrow"s).empty());
+        ASSERT(request_queue.AddFindRequest("dog"s, [](int, DocumentStatus, int rating) { return rating > 5; }).empty());
+        ASSERT_EQUAL(request_queue.GetNoResultRequests(), 2);
+        const RequestStats stats = request_queue.GetStats();
+        ASSERT_EQUAL(stats.request_count, 4u);
+        ASSERT(stats.requests_per_second > 0);
+        ASSERT(stats.latencies.p50 <= stats.latencies.p99 && stats.latencies.p99 <= stats.latencies.max);
+    }
+    {
+        // requests older than the window are not counted
+        RequestQueue request_queue(server, std::chrono::milliseconds(64));
+        request_queue.AddFindRequest("sparrow"s);
+        ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        request_queue.AddFindRequest("cat"s);
+        ASSERT_EQUAL(request_queue.GetNoResultRequests(), 0);
+        ASSERT_EQUAL(request_queue.GetStats().request_count, 1u);
+    }
+    {
+        RequestQueue request_queue(server);
+        const int thread_count = 4;
+        const int request_count = 1000;
+        std::atomic<bool> is_done = false;
+        // stats are read while the requests are added
+        std::thread reader([&] {
+            uint64_t last_count = 0;
+            while (!is_done) {
+                const RequestStats stats = request_queue.GetStats();
+                ASSERT(stats.no_result_count <= stats.request_count && stats.request_count >= last_count);
+                last_count = stats.request_count;
+            }
+        });
+        std::vector<std::thread> threads;
+        for (int t = 0; t < thread_count; ++t) {
+            threads.emplace_back([&request_queue] {
+                for (int i = 0; i < request_count; ++i) {
+                    request_queue.AddFindRequest(i % 4 == 0 ? "sparrow"s : "cat"s);
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        is_done = true;
+        reader.join();
+        const RequestStats stats = request_queue.GetStats();
+        ASSERT_EQUAL(stats.request_count, static_cast<uint64_t>(thread_count * request_count));
+        ASSERT_EQUAL(stats.no_result_count, static_cast<uint64_t>(thread_count * request_count / 4));
+        ASSERT_EQUAL(request_queue.GetStats(std::chrono::seconds(1)).request_count, stats.request_count);
+    }
+}
+
+void TestProbes() {
+    using namespace std::chrono_literals;
+    ASSERT_EQUAL(FormatDuration(950ns), "950 ns"s);
+    ASSERT_EQUAL(FormatDuration(12345ns), "12.3 us"s);
+    ASSERT_EQUAL(FormatDuration(4560us), "4.56 ms"s);
+    ASSERT_EQUAL(FormatDuration(1200ms), "1.20 s"s);
+
+    const auto get_stats = [](const Probe probe) {
+        return GetProbeStats()[static_cast<size_t>(probe)];
+    };
+    ResetProbeStats();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 3; ++t) {
+        threads.emplace_back([t] {
+            for (int i = 0; i < 1000; ++i) {
+                RecordProbe(Probe::TOP_K, std::chrono::nanoseconds(1000 + t));
+            }
+            RecordProbe(Probe::TOP_K, 5ms);
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    {
+        ScopedProbe probe(Probe::RESULT_BUILDING);
+    }
+    ProbeStats stats = get_stats(Probe::TOP_K);
+    ASSERT_EQUAL(stats.count, 3003u);
+    ASSERT(stats.total == 3 * 5ms + 3000 * 1001ns);
+    ASSERT(stats.latencies.max == 5ms);
+    // within a bucket of the histogram
+    ASSERT(stats.latencies.p50 >= 1000ns && stats.latencies.p99 < 1000ns * (LATENCY_SUB_BUCKET_COUNT + 1) / LATENCY_SUB_BUCKET_COUNT);
+    ASSERT_EQUAL(get_stats(Probe::RESULT_BUILDING).count, 1u);
+    std::ostringstream dump;
+    DumpProbeStats(dump);
+    ASSERT(dump.str().find("top-k"s) != std::string::npos);
+
+    ResetProbeStats();
+    ASSERT_EQUAL(get_stats(Probe::TOP_K).count, 0u);
+    RecordProbe(Probe::TOP_K, 1us);
+    ASSERT_EQUAL(get_stats(Probe::TOP_K).count, 1u);
+
+    SearchServer server("and with"s);
+    server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    server.AddDocument(2, "curly dog and fancy collar"s, DocumentStatus::ACTUAL, {1, 2, 3});
+    ResetProbeStats();
+    server.FindTopDocuments("curly -dog"s);
+#ifdef SEARCH_SERVER_PROBES
+    for (const Probe probe : {Probe::PARSE, Probe::MINUS_WORDS, Probe::POSTING_SCAN, Probe::ACCUMULATION, Probe::TOP_K, Probe::RESULT_BUILDING}) {
+        ASSERT_HINT(get_stats(probe).count > 0, std::string(GetProbeName(probe)));
+    }
+#else
+    for (const ProbeStats& probe_stats : GetProbeStats()) {
+        ASSERT_EQUAL(probe_stats.count, 0u);
+    }
+#endif
+}
+
 void TestSearchServer() {
+    // the allocation checks of TestQueryContext, TestResultCache and TestForwardIndex need the counting
+    // operator new, which only a build with -DSEARCH_SERVER_COUNT_ALLOCATIONS has
+    if (!IS_ALLOCATION_COUNTED) {
+        std::cerr << "Allocation checks are skipped, build with -DSEARCH_SERVER_COUNT_ALLOCATIONS to run them"s << std::endl;
+    }
     RUN_TEST(TestExcludeStopWordsFromAddedDocumentContent);
     RUN_TEST(TestExcludeDocumentsContainingMinusWords);
     RUN_TEST(TestMatchingDocument);
@@ -260,4 +1681,28 @@ void TestSearchServer() {
     RUN_TEST(TestFilterPredicate);
     RUN_TEST(TestFilterFromStatus);
     RUN_TEST(TestComputeRelevance);
+    RUN_TEST(TestTermDictionary);
+    RUN_TEST(TestPostingList);
+    RUN_TEST(TestTopDocumentsCount);
+    RUN_TEST(TestParallelScoring);
+    RUN_TEST(TestPrunedSearch);
+    RUN_TEST(TestCompressedIndex);
+    RUN_TEST(TestSnapshot);
+    RUN_TEST(TestConcurrentSearchServer);
+    RUN_TEST(TestIndexSegments);
+    RUN_TEST(TestAddDocuments);
+    RUN_TEST(TestSplitIntoWords);
+    RUN_TEST(TestQueryContext);
+    RUN_TEST(TestPreparedQuery);
+    RUN_TEST(TestResultCache);
+    RUN_TEST(TestTermStatistics);
+    RUN_TEST(TestForwardIndex);
+    RUN_TEST(TestRemoveDuplicates);
+    RUN_TEST(TestRemoveDocuments);
+    RUN_TEST(TestDocumentAttributes);
+    RUN_TEST(TestQueryExecutor);
+    RUN_TEST(TestProcessQueriesStreamed);
+    RUN_TEST(TestFindTopDocumentsAsync);
+    RUN_TEST(TestRequestQueue);
+    RUN_TEST(TestProbes);
 }
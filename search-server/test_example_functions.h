@@ -1,8 +1,21 @@
 #pragma once
 
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <random>
+#include <sstream>
 
+#include "allocation_counter.h"
 #include "search_server.h"
+#include "concurrent_search_server.h"
+#include "result_cache.h"
+#include "remove_duplicates.h"
+#include "process_queries.h"
+#include "request_queue.h"
+#include "instrumentation.h"
 
 template <typename Type1, typename Type2>
 void AssertEqualImpl(const Type1& value1, const Type2 value2, const std::string& str_value1, const std::string& str_value2,
@@ -51,4 +64,52 @@ void TestFilterFromStatus();
 
 void TestComputeRelevance();
 
+void TestTermDictionary();
+
+void TestPostingList();
+
+void TestTopDocumentsCount();
+
+void TestParallelScoring();
+
+void TestPrunedSearch();
+
+void TestCompressedIndex();
+
+void TestSnapshot();
+
+void TestConcurrentSearchServer();
+
+void TestIndexSegments();
+
+void TestAddDocuments();
+
+void TestSplitIntoWords();
+
+void TestQueryContext();
+
+void TestPreparedQuery();
+
+void TestResultCache();
+
+void TestTermStatistics();
+
+void TestForwardIndex();
+
+void TestRemoveDuplicates();
+
+void TestRemoveDocuments();
+
+void TestDocumentAttributes();
+
+void TestQueryExecutor();
+
+void TestProcessQueriesStreamed();
+
+void TestFindTopDocumentsAsync();
+
+void TestRequestQueue();
+
+void TestProbes();
+
 void TestSearchServer();
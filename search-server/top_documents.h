@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "document.h"
+
+const double INNACURATE = 1e-6;
+
+// Relevance descending, rating descending when relevances are equal up to INNACURATE,
+// id ascending as the last resort so equal documents always come out in the same order
+inline bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) < INNACURATE) {
+        if (lhs.rating != rhs.rating) {
+            return lhs.rating > rhs.rating;
+        }
+        return lhs.id < rhs.id;
+    }
+    return lhs.relevance > rhs.relevance;
+}
+
+// Keeps the max_count most relevant documents pushed into it.
+// Stored as a heap with the least relevant of the kept documents on top.
+class TopDocuments {
+public:
+    explicit TopDocuments(size_t max_count)
+        : max_count_(max_count) {
+        heap_.reserve(max_count);
+    }
+
+    void Push(const Document& document) {
+        if (heap_.size() < max_count_) {
+            heap_.push_back(document);
+            std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        } else if (max_count_ > 0 && IsMoreRelevant(document, heap_.front())) {
+            std::pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+            heap_.back() = document;
+            std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        }
+    }
+
+    void Merge(const TopDocuments& other) {
+        for (const Document& document : other.heap_) {
+            Push(document);
+        }
+    }
+
+    bool IsFull() const {
+        return heap_.size() == max_count_;
+    }
+
+    // the least relevant of the kept documents, valid only for a non-empty heap
+    const Document& GetWorst() const {
+        return heap_.front();
+    }
+
+    std::vector<Document> Extract() {
+        std::sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        return std::move(heap_);
+    }
+
+    // like Extract, but the documents are copied into the given vector and the memory of both is kept
+    void ExtractTo(std::vector<Document>& documents) {
+        std::sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        documents.assign(heap_.begin(), heap_.end());
+        heap_.clear();
+    }
+
+    void Reset(size_t max_count) {
+        max_count_ = max_count;
+        heap_.clear();
+        heap_.reserve(max_count);
+    }
+
+private:
+    size_t max_count_;
+    std::vector<Document> heap_;
+};